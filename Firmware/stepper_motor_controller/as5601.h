@@ -0,0 +1,170 @@
+/*!
+* @file as5601.h
+*
+* It is a driver for AS5601 a magnetic rotary position
+* sensor. It uses I2C protocol. The resolution of encoder
+* is 12-bit.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef AS5601_H_
+#define AS5601_H_
+
+#include "twi.h"
+
+#define AS5601_ID      0x36
+#define RAW_ANG_HIGH   0x0C
+#define RAW_ANG_LOW    0x0D
+#define STATUS_REG     0x0B
+#define AGC            0x1A
+#define MAGNITUDE_HIGH 0x1B
+#define MAGNITUDE_LOW  0x1C
+#define CONF_HIGH      0x07
+#define CONF_LOW       0x08
+
+#define AS5601_MD      0x20 ///< Status, magnet was detected
+#define AS5601_ML      0x10 ///< Status, magnet is too weak
+#define AS5601_MH      0x08 ///< Status, magnet is too strong
+#define AS5601_COUNTS  4096 ///< Counts of a turn of the encoder
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for interacting with AS5601 magnetic
+              rotary position sensor.
+*/
+/**************************************************************************/
+class AS5601 {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the I2C bus
+    */
+    /**************************************************************************/
+    void Begin() {
+        twi.init();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Queue the reading of the status and the raw angle, in one
+                  burst, the register address increments from STATUS_REG to
+                  RAW_ANG_LOW
+        @param    done
+                  Called from the interrupt at the end of the reading, e.g.
+                  to take the step count at that time, may be NULL
+        @param    arg
+                  Argument for done
+        @return   False if the reading could not be queued
+    */
+    /**************************************************************************/
+    bool request(void (*done)(twi_transfer &t), void *arg) {
+        if (busy()) {
+            return false;
+        }
+        _read.addr = AS5601_ID;
+        _read.tx = &_reg;
+        _read.tx_len = 1;
+        _read.rx = _data;
+        _read.rx_len = sizeof(_data);
+        _read.done = done;
+        _read.arg = arg;
+        return twi.submit(_read);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if the reading is still queued
+        @return   True if queued
+    */
+    /**************************************************************************/
+    bool busy() {
+        return _read.state == twi_queued;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Calculate an unwrap the position from the finished reading
+        @param    new_pos
+                  Calculate the current position of the sensor in mdeg, it
+                  is kept if the magnet is not detected
+        @return   The state of the AS5601:
+                  Magnet is too strong
+                  Magnet is too weak
+                  Magnet was detect
+                  0 if the sensor did not answer
+    */
+    /**************************************************************************/
+    uint8_t get_pos(int32_t *new_pos) {
+        if (_read.state != twi_done) {
+            return 0;
+        }
+        _read.state = twi_idle;
+        uint8_t status_val = _data[0];
+        // Check the status register
+        if ((status_val & AS5601_MD) && !(status_val & AS5601_ML)
+                && !(status_val & AS5601_MH)) {
+            int16_t raw_angle = (_data[1] << 8 | _data[2]) &
+                                (AS5601_COUNTS - 1);
+            // Unwrap the angle
+            int16_t delta_raw_pos = _raw_prev_pos - raw_angle;
+            if (delta_raw_pos > AS5601_COUNTS / 2)
+                _n++;
+            else if (delta_raw_pos < -AS5601_COUNTS / 2)
+                _n--;
+            _raw_prev_pos = raw_angle;
+            // Calculate the real angle, 360000 / 4096 = 5625 / 64 mdeg
+            // per count, in int32_t up to 46 turns of the axis
+            int32_t counts = raw_angle + AS5601_COUNTS * _n;
+            *new_pos = -(counts * 5625 / 64 / _enc_ratio) - _angle_offset;
+        }
+        return status_val;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the offset angle, so a position reads as the given
+                  angle
+        @param    current_pos
+                  Position from get_pos() in mdeg
+        @param    angle
+                  Angle of that position in mdeg
+    */
+    /**************************************************************************/
+    void set_zero(int32_t current_pos, int32_t angle) {
+        _angle_offset += current_pos - angle;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Reset zero position set the offset to zero
+    */
+    /**************************************************************************/
+    void init_zero() {
+        _angle_offset = 0;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the gear ratio between encoder and measure axis
+        @param    enc_ratio
+                  An uitn8_t, that represents the gear ratio
+    */
+    /**************************************************************************/
+    void set_gear_ratio(uint8_t enc_ratio) {
+        _enc_ratio = enc_ratio;
+    }
+
+private:
+    int32_t _angle_offset = 0;
+    int32_t _n = 0;
+    int16_t _raw_prev_pos = 0;
+    uint8_t _enc_ratio = 1;
+    uint8_t _reg = STATUS_REG;
+    uint8_t _data[3];
+    twi_transfer _read = { };
+};
+
+#endif /* AS5601_H_ */
@@ -0,0 +1,474 @@
+/*!
+* @file binary.h
+*
+* It is a binary protocol beside easycomm, ENABLE_BINARY, for a client that
+* needs more commands and telemetry per second than the text lines carry.
+* The easycomm command BP switches the port to it at a higher baudrate.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef BINARY_H_
+#define BINARY_H_
+
+#include "hal.h"
+#include "globals.h"
+#include "uart.h"
+#include "stepper.h"
+#include "wrap.h"
+#include "units.h"
+#include "trajectory.h"
+
+#if ENABLE_RS485
+#error "The binary protocol is point to point, it does not work on the RS485 bus"
+#endif
+
+#define BIN_BAUD_MIN 115200 ///< Lowest baudrate of the binary protocol
+#define BIN_BAUD_MAX (F_CPU / 8) ///< Highest baudrate of the USART0 at double speed
+#define BIN_BAUD_ERROR 22   ///< Largest error of the real baudrate in 0.1%, 115200 is 2.1% off at 16 MHz, 230400 3.5%
+#define BIN_TIMEOUT  5000   ///< Time without a valid frame before easycomm takes the port back in ms
+#define BIN_FRAME    32     ///< Longest frame, sequence number, type, fields and CRC
+
+/** Types of the frames, a reply has the type of the request | 0x80 */
+enum _bin_type {
+    bin_telemetry = 0x01, ///< Get the telemetry
+    bin_move = 0x02,      ///< Move to az, el, int32_t mdeg
+    bin_track = 0x03,     ///< Queue a trajectory sample, uint32_t ms, az, el int32_t mdeg
+    bin_stop = 0x04,      ///< Stop and hold
+    bin_sync = 0x05,      ///< Set the trajectory time, uint32_t ms
+    bin_clear = 0x06,     ///< Remove the trajectory samples
+    bin_velocity = 0x07,  ///< Move az, el at a speed, int32_t mdeg/s
+    bin_exit = 0x08,      ///< Go back to easycomm
+    bin_reply = 0x80,     ///< Flag of the replies
+    bin_nak = 0xFF        ///< Reply of a refused request, reason and type
+};
+
+/** Reasons of a refused request */
+enum _bin_reason {
+    bin_ok = 0, bin_unknown = 1, bin_length = 2, bin_rejected = 3
+};
+
+/**
+ * Telemetry, the reply of every accepted request. The fields are little
+ * endian, as the AVR, and packed
+ */
+struct __attribute__((packed)) _bin_telemetry {
+    uint8_t status;     ///< _rotator_status
+    uint8_t error;      ///< _rotator_error
+    uint8_t mode;       ///< _control_mode
+    uint8_t flags;      ///< End-stop az = 1, end-stop el = 2, homed = 4
+    int32_t az, el;     ///< Position in mdeg, the azimuth is the cable position
+    int32_t az_speed;   ///< Speed of azimuth in mdeg/s
+    int32_t el_speed;   ///< Speed of elevation in mdeg/s
+    uint32_t time;      ///< Trajectory time in ms
+    uint8_t track_free; ///< Free places of the trajectory queue
+    uint8_t errors;     ///< Frames with a bad CRC or COBS since the start, wraps
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the binary protocol. A frame is the
+              sequence number, the type, the fields and the CRC-16/CCITT
+              (polynomial 0x1021, initial 0xFFFF, high byte first) of them,
+              COBS encoded and ended by 0x00. The reply has the sequence
+              number of the request. A request with the sequence number of
+              the last one is a retry, it is not run again and gets the same
+              answer. After BIN_TIMEOUT without a valid frame, e.g. the
+              client closed, the port returns to easycomm at its baudrate
+*/
+/**************************************************************************/
+class binary_link {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Switch to the binary protocol once the pending easycomm
+                  reply is sent
+        @param    baudrate
+                  The baudrate, BIN_BAUD_MIN to BIN_BAUD_MAX, that the
+                  USART0 makes within BIN_BAUD_ERROR, e.g. 115200, 250000 or
+                  500000 at 16 MHz
+        @param    easycomm_baudrate
+                  The baudrate to go back to
+        @return   False if the baudrate is out of range or too far off
+    */
+    /**************************************************************************/
+    bool open(uint32_t baudrate, uint32_t easycomm_baudrate) {
+        if (baudrate < BIN_BAUD_MIN || baudrate > BIN_BAUD_MAX) {
+            return false;
+        }
+        uint32_t rate = HAL_UART_RATE(baudrate);
+        uint32_t error = rate > baudrate ? rate - baudrate : baudrate - rate;
+        if (error * 1000 > baudrate * BIN_BAUD_ERROR) {
+            return false;
+        }
+        _baudrate = baudrate;
+        _easycomm_baudrate = easycomm_baudrate;
+        _state = bin_opening;
+        return true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Run the binary protocol, called from easycomm_proc
+        @return   True if the binary protocol has the port
+    */
+    /**************************************************************************/
+    bool proc() {
+        switch (_state) {
+        case bin_opening:
+        case bin_closing:
+            // Change the baudrate after the last byte left the UART
+            if (!uart0.tx_empty() || !hal_uart_sent()) {
+                return true;
+            }
+            if (_state == bin_closing) {
+                uart0.begin(_easycomm_baudrate);
+                _state = bin_closed;
+                return false;
+            }
+            uart0.begin(_baudrate);
+            _len = 0;
+            _last_seq = -1;
+            _valid = millis();
+            _state = bin_open;
+            return true;
+        case bin_open:
+            while (uart0.available() > 0 && _state == bin_open) {
+                feed(uart0.read());
+            }
+            if (_state == bin_open && millis() - _valid > BIN_TIMEOUT) {
+                _state = bin_closing;
+            }
+            return true;
+        default:
+            return false;
+        }
+    }
+
+private:
+    /** States of the link */
+    enum _link_state {
+        bin_closed, bin_opening, bin_open, bin_closing
+    };
+
+    /** Entry of the dispatch table */
+    struct _request {
+        uint8_t type;
+        uint8_t length; ///< Bytes of the fields
+        uint8_t (*handler)(binary_link &link, const uint8_t *fields);
+    };
+
+    static const _request _requests[] PROGMEM;
+
+    uint8_t _frame[BIN_FRAME + 1]; ///< Received frame, COBS encoded
+    uint8_t _len = 0;              ///< Received bytes, above BIN_FRAME drops the frame
+    uint8_t _state = bin_closed;
+    uint32_t _baudrate = 0, _easycomm_baudrate = 0;
+    uint32_t _valid = 0;           ///< Time of the last valid frame
+    int16_t _last_seq = -1;        ///< Sequence number of the last request
+    uint8_t _last_type = 0, _last_result = bin_ok;
+    uint8_t _errors = 0;
+
+    /**************************************************************************/
+    /*!
+        @brief    Feed a received byte, 0x00 ends a frame
+        @param    c
+                  The byte
+    */
+    /**************************************************************************/
+    void feed(uint8_t c) {
+        if (c != 0) {
+            if (_len <= BIN_FRAME) {
+                _frame[_len] = c;
+            }
+            if (_len < UINT8_MAX) {
+                _len++;
+            }
+            return;
+        }
+        uint8_t received = _len;
+        _len = 0;
+        if (received == 0) {
+            // Empty, a client may send 0x00 to end a partial frame
+            return;
+        }
+        uint8_t len = received <= BIN_FRAME ? decode(_frame, received) : 0;
+        if (len < 4 || crc16(_frame, len) != 0) {
+            _errors++;
+            return;
+        }
+        _valid = millis();
+        uint8_t seq = _frame[0];
+        uint8_t type = _frame[1];
+        if (seq != _last_seq || type != _last_type) {
+            _last_seq = seq;
+            _last_type = type;
+            _last_result = dispatch(type, &_frame[2], len - 4);
+        }
+        answer(seq, type, _last_result);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Run the handler of a request
+        @param    type
+                  The type of the request
+        @param    fields
+                  The fields
+        @param    length
+                  Bytes of the fields
+        @return   _bin_reason
+    */
+    /**************************************************************************/
+    uint8_t dispatch(uint8_t type, const uint8_t *fields, uint8_t length) {
+        for (const _request *req = _requests; ; req++) {
+            uint8_t entry = pgm_read_byte(&req->type);
+            if (entry == 0) {
+                return bin_unknown;
+            }
+            if (entry == type) {
+                if (pgm_read_byte(&req->length) != length) {
+                    return bin_length;
+                }
+                uint8_t (*handler)(binary_link &link, const uint8_t *fields);
+                handler = (uint8_t (*)(binary_link &, const uint8_t *))
+                          pgm_read_ptr(&req->handler);
+                return handler(*this, fields);
+            }
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Send the reply of a request, the telemetry or the refusal.
+                  The reply is dropped if the TX ring is full, the client
+                  retries
+        @param    seq
+                  The sequence number of the request
+        @param    type
+                  The type of the request
+        @param    result
+                  _bin_reason
+    */
+    /**************************************************************************/
+    void answer(uint8_t seq, uint8_t type, uint8_t result) {
+        // The request is done, its buffer takes the reply
+        uint8_t *p = _frame;
+        uint8_t len;
+        p[0] = seq;
+        if (result != bin_ok) {
+            p[1] = bin_nak;
+            p[2] = result;
+            p[3] = type;
+            len = 4;
+        } else {
+            _bin_telemetry t;
+            int32_t az = control_az.input;
+            t.status = rotator.rotator_status;
+            t.error = rotator.rotator_error;
+            t.mode = rotator.control_mode;
+            t.flags = rotator.switch_az | rotator.switch_el << 1 |
+                      rotator.homing_flag << 2;
+            t.az = az;
+            t.el = control_el.input;
+            t.az_speed = control_az.speed;
+            t.el_speed = control_el.speed;
+            t.time = track.now();
+            t.track_free = track.free();
+            t.errors = _errors;
+            p[1] = type | bin_reply;
+            memcpy(&p[2], &t, sizeof(t));
+            len = 2 + sizeof(t);
+        }
+        uint16_t crc = crc16(p, len);
+        p[len++] = crc >> 8;
+        p[len++] = crc;
+        uint8_t out[BIN_FRAME + 2];
+        uart0.write(out, encode(p, len, out));
+        if (type == bin_exit && result == bin_ok) {
+            _state = bin_closing;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    CRC-16/CCITT of bytes, the bytes with their CRC give 0
+        @param    data
+                  The bytes
+        @param    len
+                  Number of bytes
+        @return   The CRC
+    */
+    /**************************************************************************/
+    static uint16_t crc16(const uint8_t *data, uint8_t len) {
+        uint16_t crc = 0xFFFF;
+        for (uint8_t i = 0; i < len; i++) {
+            // Byte-wise, without a table or a loop over the bits
+            crc = (crc >> 8) | (crc << 8);
+            crc ^= data[i];
+            crc ^= (crc & 0xFF) >> 4;
+            crc ^= crc << 12;
+            crc ^= (crc & 0xFF) << 5;
+        }
+        return crc;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Decode a COBS frame in place, without the 0x00 at the end
+        @param    buf
+                  The frame
+        @param    len
+                  Number of encoded bytes
+        @return   Number of decoded bytes, 0 if the frame is invalid
+    */
+    /**************************************************************************/
+    static uint8_t decode(uint8_t *buf, uint8_t len) {
+        uint8_t in = 0, out = 0;
+        while (in < len) {
+            uint8_t code = buf[in++];
+            if (in + code - 1 > len) {
+                return 0;
+            }
+            for (uint8_t i = 1; i < code; i++) {
+                buf[out++] = buf[in++];
+            }
+            if (code != 0xFF && in < len) {
+                buf[out++] = 0;
+            }
+        }
+        return out;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Encode a frame with COBS and end it with 0x00, for frames
+                  shorter than 254 bytes
+        @param    src
+                  The frame
+        @param    len
+                  Number of bytes
+        @param    dst
+                  The encoded frame, len + 2 bytes
+        @return   Number of encoded bytes
+    */
+    /**************************************************************************/
+    static uint8_t encode(const uint8_t *src, uint8_t len, uint8_t *dst) {
+        uint8_t code_at = 0, out = 1, code = 1;
+        for (uint8_t i = 0; i < len; i++) {
+            if (src[i] == 0) {
+                dst[code_at] = code;
+                code_at = out++;
+                code = 1;
+            } else {
+                dst[out++] = src[i];
+                code++;
+            }
+        }
+        dst[code_at] = code;
+        dst[out++] = 0;
+        return out;
+    }
+
+    static int32_t field(const uint8_t *fields, uint8_t i) {
+        int32_t value;
+        memcpy(&value, &fields[4 * i], sizeof(value));
+        return value;
+    }
+
+    static uint8_t req_telemetry(binary_link &link, const uint8_t *fields) {
+        // The reply is the telemetry
+        (void)link;
+        (void)fields;
+        return bin_ok;
+    }
+
+    static uint8_t req_move(binary_link &link, const uint8_t *fields) {
+        // Move to the absolute position, the azimuth on the turn of the
+        // cable wrap that the axis reaches first
+        (void)link;
+        if (rotator.control_mode == speed) {
+            hold_position();
+        }
+        rotator.control_mode = position;
+        control_az.setpoint = wrap.shortest(field(fields, 0),
+                                            control_az.input,
+                                            control_az.speed);
+        control_el.setpoint = field(fields, 1);
+        return bin_ok;
+    }
+
+    static uint8_t req_track(binary_link &link, const uint8_t *fields) {
+        // Queue a trajectory sample
+        (void)link;
+        uint32_t t = field(fields, 0);
+        if (!track.add(t, field(fields, 1), field(fields, 2))) {
+            return bin_rejected;
+        }
+        rotator.control_mode = tracking;
+        return bin_ok;
+    }
+
+    static uint8_t req_stop(binary_link &link, const uint8_t *fields) {
+        // Stop moving
+        (void)link;
+        (void)fields;
+        track.clear();
+        rotator.control_mode = position;
+        hold_position();
+        return bin_ok;
+    }
+
+    static uint8_t req_sync(binary_link &link, const uint8_t *fields) {
+        // Set the trajectory time
+        (void)link;
+        track.sync(field(fields, 0));
+        return bin_ok;
+    }
+
+    static uint8_t req_clear(binary_link &link, const uint8_t *fields) {
+        // Remove the trajectory samples and hold the current position
+        (void)link;
+        (void)fields;
+        track.clear();
+        if (rotator.control_mode == tracking) {
+            rotator.control_mode = position;
+            hold_position();
+        }
+        return bin_ok;
+    }
+
+    static uint8_t req_velocity(binary_link &link, const uint8_t *fields) {
+        // Move both axis at a speed, an axis at 0 brakes and holds
+        (void)link;
+        set_velocity(control_az, field(fields, 0));
+        set_velocity(control_el, field(fields, 1));
+        return bin_ok;
+    }
+
+    static uint8_t req_exit(binary_link &link, const uint8_t *fields) {
+        // The reply is sent at the binary baudrate, then easycomm
+        (void)link;
+        (void)fields;
+        return bin_ok;
+    }
+};
+
+/** Dispatch table, ends with type 0 */
+const binary_link::_request binary_link::_requests[] PROGMEM = {
+    { bin_track, 12, binary_link::req_track },
+    { bin_telemetry, 0, binary_link::req_telemetry },
+    { bin_move, 8, binary_link::req_move },
+    { bin_velocity, 8, binary_link::req_velocity },
+    { bin_stop, 0, binary_link::req_stop },
+    { bin_sync, 4, binary_link::req_sync },
+    { bin_clear, 0, binary_link::req_clear },
+    { bin_exit, 0, binary_link::req_exit },
+    { 0, 0, NULL }
+};
+
+binary_link binary;
+
+#endif /* BINARY_H_ */
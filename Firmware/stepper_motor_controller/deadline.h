@@ -0,0 +1,234 @@
+/*!
+* @file deadline.h
+*
+* It is the deadline monitor of the loop, with the watchdog. The loop
+* stamps the stage that runs, the communication, the sensors, the stepping
+* or the homing, and feeds the watchdog once per round. When a round misses
+* the deadline, the watchdog interrupt saves the stage, its time and the
+* longest run of each stage in RAM that the reset keeps, and the PM command
+* reads them once after the reboot.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef DEADLINE_H_
+#define DEADLINE_H_
+
+#include <stddef.h>
+#include "hal.h"
+
+#define DEADLINE_TIMEOUT WDTO_2S ///< Watchdog timeout, the longest round of the loop
+#define DEADLINE_MAGIC   0x504D  ///< Mark of a post-mortem record
+#define DEADLINE_STAGES  4       ///< Stages of the loop, without deadline_none
+
+/** Stage of the loop */
+enum _deadline_stage {
+    deadline_none = 0,     ///< Between the stages, or in the setup
+    deadline_comm = 1,     ///< easycomm and the binary protocol
+    deadline_sensors = 2,  ///< End-stops and I2C sensors
+    deadline_stepping = 3, ///< Control of the axis, trajectory and journal
+    deadline_homing = 4    ///< A round of the homing loop
+};
+
+/**
+ * Post-mortem of a watchdog reset. It is in RAM that the start-up does not
+ * initialize, the mark and the check tell a record from the content of the
+ * RAM after the power-on.
+ */
+struct _deadline_record {
+    uint16_t magic;                  ///< DEADLINE_MAGIC
+    uint8_t resets;                  ///< Watchdog resets since the power-on
+    uint8_t stage;                   ///< _deadline_stage at the timeout
+    uint32_t time;                   ///< Time of the timeout since the start in ms
+    uint16_t in_loop;                ///< Time in the round at the timeout in ms
+    uint16_t in_stage;               ///< Time in the stage at the timeout in ms
+    uint16_t worst[DEADLINE_STAGES]; ///< Longest run of each stage in ms
+    uint8_t check;                   ///< Sum of the bytes above, complemented
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the deadline monitor. A round starts
+              with loop(), it feeds the watchdog, and each stage with
+              start(). The time of a stage is in us, from its start to the
+              start of the next stage or round, and the longest one of each
+              stage is kept
+*/
+/**************************************************************************/
+class deadline_monitor {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Check the record of the reset and start the watchdog,
+                  called at the end of the setup. The RAM keeps a record
+                  through any reset, so only a watchdog reset counts it
+        @return   True if a watchdog reset left a post-mortem
+    */
+    /**************************************************************************/
+    bool init() {
+        bool found = hal_watchdog_reset() && valid(_saved);
+        if (!found) {
+            // Power-on, reset pin or RB, no post-mortem before
+            _saved.magic = 0;
+            _saved.resets = 0;
+        }
+        _loop = _since = micros();
+        hal_watchdog_start(DEADLINE_TIMEOUT);
+        return found;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Start a round of the loop and feed the watchdog
+    */
+    /**************************************************************************/
+    void loop() {
+        uint32_t now = micros();
+        end(now);
+        hal_watchdog_feed();
+        _stage = deadline_none;
+        _loop = _since = now;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Start a stage of the round
+        @param    stage
+                  _deadline_stage
+    */
+    /**************************************************************************/
+    void start(uint8_t stage) {
+        uint32_t now = micros();
+        end(now);
+        _stage = stage;
+        _since = now;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Save the post-mortem, called from the watchdog interrupt
+    */
+    /**************************************************************************/
+    void capture() {
+        uint8_t resets = _saved.resets;
+        snapshot(&_saved);
+        _saved.resets = resets < UINT8_MAX ? resets + 1 : resets;
+        _saved.check = check(_saved);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the post-mortem of the last watchdog reset
+        @param    record
+                  The record
+        @return   False if there was none since the power-on
+    */
+    /**************************************************************************/
+    bool saved(_deadline_record *record) {
+        *record = _saved;
+        return valid(_saved);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Drop the post-mortem once it is read, the count of the
+                  resets stays for the next one
+    */
+    /**************************************************************************/
+    void clear() {
+        _saved.magic = 0;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the state of the current run, as a post-mortem would
+                  save it, with the resets before it
+        @param    record
+                  The record
+    */
+    /**************************************************************************/
+    void snapshot(_deadline_record *record) {
+        uint32_t now = micros();
+        record->magic = DEADLINE_MAGIC;
+        record->resets = _saved.resets;
+        record->stage = _stage;
+        record->time = millis();
+        record->in_loop = ms(now - _loop);
+        record->in_stage = ms(now - _since);
+        for (uint8_t i = 0; i < DEADLINE_STAGES; i++) {
+            record->worst[i] = ms(_worst[i]);
+        }
+    }
+
+private:
+    static _deadline_record _saved;    ///< Post-mortem, kept by the reset
+    uint8_t _stage = deadline_none;    ///< _deadline_stage that runs
+    uint32_t _loop = 0;                ///< Start of the round in us
+    uint32_t _since = 0;               ///< Start of the stage in us
+    uint32_t _worst[DEADLINE_STAGES] = { }; ///< Longest run of each stage in us
+
+    /**************************************************************************/
+    /*!
+        @brief    End the stage that runs and keep its time if it is the
+                  longest
+        @param    now
+                  Time in us
+    */
+    /**************************************************************************/
+    void end(uint32_t now) {
+        if (_stage == deadline_none) {
+            return;
+        }
+        uint32_t t = now - _since;
+        if (t > _worst[_stage - 1]) {
+            _worst[_stage - 1] = t;
+        }
+    }
+
+    /** Round a time in us to ms, up to 65535 */
+    static uint16_t ms(uint32_t us) {
+        us = (us + 500) / 1000;
+        return us > UINT16_MAX ? UINT16_MAX : us;
+    }
+
+    static bool valid(const _deadline_record &r) {
+        return r.magic == DEADLINE_MAGIC && r.check == check(r);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check of a record, the complement of the sum of its bytes up
+                  to the check
+        @param    r
+                  The record
+        @return   The check
+    */
+    /**************************************************************************/
+    static uint8_t check(const _deadline_record &r) {
+        const uint8_t *p = (const uint8_t *)&r;
+        uint8_t sum = 0;
+        for (uint8_t i = 0; i < offsetof(_deadline_record, check); i++) {
+            sum += p[i];
+        }
+        return ~sum;
+    }
+};
+
+_deadline_record deadline_monitor::_saved HAL_NOINIT;
+
+deadline_monitor deadline;
+
+/**************************************************************************/
+/*!
+    @brief    Watchdog interrupt routine, the round of the loop missed the
+              deadline. It saves the post-mortem and resets the board
+*/
+/**************************************************************************/
+ISR(WDT_vect) {
+    deadline.capture();
+    hal_watchdog_restart();
+}
+
+#endif /* DEADLINE_H_ */
@@ -10,18 +10,44 @@
 #ifndef LIBRARIES_EASYCOMM_H_
 #define LIBRARIES_EASYCOMM_H_
 
-#include <Arduino.h>
-#include <WString.h>
-#include <avr/wdt.h>
-//#include "rs485.h"
+#include "hal.h"
 #include "rotator_pins.h"
 #include "globals.h"
+#include "uart.h"
+#include "reply.h"
+#include "stepper.h"
+#include "wrap.h"
+#include "units.h"
+#include "trajectory.h"
+#include "utc.h"
+#include "passes.h"
+#include "deadline.h"
+#if ENABLE_SGP4
+#include "orbit.h"
+#endif
+#if ENABLE_ENCODER
+#include "sensors.h"
+#endif
+#if ENABLE_BINARY
+#include "binary.h"
+#endif
 
-#define RS485_TX_TIME 9     ///< Delay "t"ms to write in serial for RS485 implementation
-#define BUFFER_SIZE   256   ///< Set the size of serial buffer
-#define BAUDRATE      19200 ///< Set the Baudrate of easycomm 3 protocol
+#define MAX_TOKENS    4     ///< Maximum number of tokens kept from a command line
+#define MAX_INTEGER   999999L ///< Largest integer part of a number
+#define BAUDRATE      9600  ///< Set the Baudrate of easycomm 3 protocol
+#define PUSH_MIN_PERIOD 50  ///< Shortest period of the pushed telemetry in ms
+#define BACKLASH_MAX  5000L ///< Largest backlash of a gear in mdeg
 
-//rs485 rs485(RS485_DIR, RS485_TX_TIME);
+/** Build the opcode of a command from its first two letters */
+#define OPCODE(a, b) ((uint16_t)(a) << 8 | (uint8_t)(b))
+
+/** Command line token, e.g. "AZ12.5" or "1" */
+struct _token {
+    char word[2];     ///< First two letters of the token
+    uint8_t letters;  ///< Number of letters in the token
+    bool has_value;   ///< The token carries a valid number
+    int32_t value;    ///< Number in thousandths, e.g. 12.5 -> 12500
+};
 
 /**************************************************************************/
 /*!
@@ -33,366 +59,1061 @@ public:
 
     /**************************************************************************/
     /*!
-        @brief    Initialize the RS485 bus
+        @brief    Initialize the serial port, or the RS485 bus
     */
     /**************************************************************************/
     void easycomm_init() {
-       // rs485.begin(BAUDRATE);
-	    Serial.begin(9600);
+        uart0.begin(BAUDRATE);
+#if ENABLE_RS485
+        uart0.direction(RS485_DIR);
+#endif
+        reset_line();
     }
 
     /**************************************************************************/
     /*!
-        @brief    Get the commands from RS485 and response to the client
+        @brief    Get the commands from RS485 and response to the client.
+                  The bytes are tokenized as they arrive, so a command may
+                  be split over several calls and the work per byte is
+                  bounded
     */
     /**************************************************************************/
     void easycomm_proc() {
-        char buffer[BUFFER_SIZE];
-        char incomingByte;
-        char *Data = buffer;
-        char *rawData;
-        static uint16_t BufferCnt = 0;
-        char data[100];
-        String str1, str2, str3, str4, str5, str6;
-
-        // Read from serial
-        while (Serial.available() > 0) {
-            incomingByte = Serial.read();
-
-            // Read new data, '\n' means new pacakage
-            if (incomingByte == '\n' || incomingByte == '\r') {
-                buffer[BufferCnt] = 0;
-                if (buffer[0] == 'A' && buffer[1] == 'Z') {
-                    if (buffer[2] == ' ' && buffer[3] == 'E' &&
-                        buffer[4] == 'L') {
-                        // Send current absolute position in deg
-                        str1 = String("AZ");
-                        str2 = String(control_az.input, 1);
-                        str3 = String(" EL");
-                        str4 = String(control_el.input, 1);
-                        str5 = String("\n");
-                        Serial.print(str1 + str2 + str3 + str4 + str5);
-                    } else {
-                        // Get the absolute position in deg for azimuth
-                        rotator.control_mode = position;
-                        rawData = strtok_r(Data, " ", &Data);
-                        strncpy(data, rawData + 2, 10);
-                        if (isNumber(data)) {
-                            control_az.setpoint = atof(data);
-                        }
-                        // Get the absolute position in deg for elevation
-                        rawData = strtok_r(Data, " ", &Data);
-                        if (rawData[0] == 'E' && rawData[1] == 'L') {
-                            strncpy(data, rawData + 2, 10);
-                            if (isNumber(data)) {
-                                control_el.setpoint = atof(data);
-                            }
-                        }
-                    }
-                } else if (buffer[0] == 'E' && buffer[1] == 'L') {
-                        // Get the absolute position in deg for elevation
-                        rotator.control_mode = position;
-                        rawData = strtok_r(Data, " ", &Data);
-                        if (rawData[0] == 'E' && rawData[1] == 'L') {
-                            strncpy(data, rawData + 2, 10);
-                            if (isNumber(data)) {
-                                control_el.setpoint = atof(data);
-                            }
-                        }
-                } else if (buffer[0] == 'V' && buffer[1] == 'U') {
-                    // Elevation increase speed in mdeg/s
-                    rotator.control_mode = speed;
-                    strncpy(data, Data + 2, 10);
-                    if (isNumber(data)) {
-                        // Convert to deg/s
-                        control_el.setpoint_speed = atof(data) / 1000;
-                    }
-                } else if (buffer[0] == 'V' && buffer[1] == 'D') {
-                    // Elevation decrease speed in mdeg/s
-                    rotator.control_mode = speed;
-                    strncpy(data, Data + 2, 10);
-                    if (isNumber(data)) {
-                        // Convert to deg/s
-                        control_el.setpoint_speed = - atof(data) / 1000;
-                    }
-                } else if (buffer[0] == 'V' && buffer[1] == 'L') {
-                    // Azimuth increase speed in mdeg/s
-                    rotator.control_mode = speed;
-                    strncpy(data, Data + 2, 10);
-                    if (isNumber(data)) {
-                        // Convert to deg/s
-                        control_az.setpoint_speed = atof(data) / 1000;
-                    }
-                } else if (buffer[0] == 'V' && buffer[1] == 'R') {
-                    // Azimuth decrease speed in mdeg/s
-                    rotator.control_mode = speed;
-                    strncpy(data, Data + 2, 10);
-                    if (isNumber(data)) {
-                        // Convert to deg/s
-                        control_az.setpoint_speed = - atof(data) / 1000;
-                    }
-                } else if (buffer[0] == 'S' && buffer[1] == 'A' &&
-                           buffer[2] == ' ' && buffer[3] == 'S' &&
-                           buffer[4] == 'E') {
-                    // Stop Moving
-                    rotator.control_mode = position;
-                    str1 = String("AZ");
-                    str2 = String(control_az.input, 1);
-                    str3 = String(" EL");
-                    str4 = String(control_el.input, 1);
-                    str5 = String("\n");
-                    Serial.print(str1 + str2 + str3 + str4 + str5);
-                    control_az.setpoint = control_az.input;
-                    control_el.setpoint = control_el.input;
-                } else if (buffer[0] == 'R' && buffer[1] == 'E' &&
-                           buffer[2] == 'S' && buffer[3] == 'E' &&
-                           buffer[4] == 'T') {
-                    // Reset the rotator, go to home position
-                    str1 = String("AZ");
-                    str2 = String(control_az.input, 1);
-                    str3 = String(" EL");
-                    str4 = String(control_el.input, 1);
-                    str5 = String("\n");
-                    Serial.print(str1 + str2 + str3 + str4 + str5);
-                    rotator.homing_flag = false;
-                } else if (buffer[0] == 'P' && buffer[1] == 'A' &&
-                           buffer[2] == 'R' && buffer[3] == 'K' ) {
-                    // Park the rotator
-                    rotator.control_mode = position;
-                    str1 = String("AZ");
-                    str2 = String(control_az.input, 1);
-                    str3 = String(" EL");
-                    str4 = String(control_el.input, 1);
-                    str5 = String("\n");
-                    Serial.print(str1 + str2 + str3 + str4 + str5);
-                    control_az.setpoint = rotator.park_az;
-                    control_el.setpoint = rotator.park_el;
-                } else if (buffer[0] == 'V' && buffer[1] == 'E') {
-                    // Get the version if rotator controller
-                    str1 = String("VE");
-                    str2 = String("SatNOGS-v2.2");
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '0') {
-                    // Get the inside temperature
-                    str1 = String("IP0,");
-                    str2 = String(rotator.inside_temperature, DEC);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '1') {
-                    // Get the status of end-stop, azimuth
-                    str1 = String("IP1,");
-                    str2 = String(rotator.switch_az, DEC);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '2') {
-                    // Get the status of end-stop, elevation
-                    str1 = String("IP2,");
-                    str2 = String(rotator.switch_el, DEC);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '3') {
-                    // Get the current position of azimuth in deg
-                    str1 = String("IP3,");
-                    str2 = String(control_az.input, 2);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '4') {
-                    // Get the current position of elevation in deg
-                    str1 = String("IP4,");
-                    str2 = String(control_el.input, 2);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '5') {
-                    // Get the load of azimuth, in range of 0-1023
-                    str1 = String("IP5,");
-                    str2 = String(control_az.load, DEC);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '6') {
-                    // Get the load of elevation, in range of 0-1023
-                    str1 = String("IP6,");
-                    str2 = String(control_el.load, DEC);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '7') {
-                    // Get the speed of azimuth in deg/s
-                    str1 = String("IP7,");
-                    str2 = String(control_az.speed, 2);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'I' && buffer[1] == 'P' &&
-                           buffer[2] == '8') {
-                    // Get the speed of elevation in deg/s
-                    str1 = String("IP8,");
-                    str2 = String(control_el.speed, 2);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'G' && buffer[1] == 'S') {
-                    // Get the status of rotator
-                    str1 = String("GS");
-                    str2 = String(rotator.rotator_status, DEC);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if (buffer[0] == 'G' && buffer[1] == 'E') {
-                    // Get the error of rotator
-                    str1 = String("GE");
-                    str2 = String(rotator.rotator_error, DEC);
-                    str3 = String("\n");
-                    Serial.print(str1 + str2 + str3);
-                } else if(buffer[0] == 'C' && buffer[1] == 'R') {
-                    // Get Configuration of rotator
-                    if (buffer[3] == '1') {
-                        // Get Kp Azimuth gain
-                        str1 = String("1,");
-                        str2 = String(control_az.p, 2);
-                        str3 = String("\n");
-                        Serial.print(str1 + str2 + str3);
-                    } else if (buffer[3] == '2') {
-                        // Get Ki Azimuth gain
-                        str1 = String("2,");
-                         str2 = String(control_az.i, 2);
-                         str3 = String("\n");
-                         Serial.print(str1 + str2 + str3);
-                    } else if (buffer[3] == '3') {
-                        // Get Kd Azimuth gain
-                        str1 = String("3,");
-                        str2 = String(control_az.d, 2);
-                        str3 = String("\n");
-                        Serial.print(str1 + str2 + str3);
-                    } else if (buffer[3] == '4') {
-                        // Get Kp Elevation gain
-                        str1 = String("4,");
-                         str2 = String(control_el.p, 2);
-                         str3 = String("\n");
-                         Serial.print(str1 + str2 + str3);
-                    } else if (buffer[3] == '5') {
-                        // Get Ki Elevation gain
-                        str1 = String("5,");
-                        str2 = String(control_el.i, 2);
-                        str3 = String("\n");
-                        Serial.print(str1 + str2 + str3);
-                    } else if (buffer[3] == '6') {
-                        // Get Kd Elevation gain
-                        str1 = String("6,");
-                        str2 = String(control_el.d, 2);
-                        str3 = String("\n");
-                        Serial.print(str1 + str2 + str3);
-                    } else if (buffer[3] == '7') {
-                        // Get Azimuth park position
-                        str1 = String("7,");
-                        str2 = String(rotator.park_az, 2);
-                        str3 = String("\n");
-                        Serial.print(str1 + str2 + str3);
-                    } else if (buffer[3] == '8') {
-                        // Get Elevation park position
-                        str1 = String("8,");
-                        str2 = String(rotator.park_el, 2);
-                        str3 = String("\n");
-                        Serial.print(str1 + str2 + str3);
-                    } else if (buffer[3] == '9') {
-                        // Get control mode
-                        str1 = String("9,");
-                        str2 = String(rotator.control_mode);
-                        str3 = String("\n");
-                        Serial.print(str1 + str2 + str3);
-                    }
-                } else if (buffer[0] == 'C' && buffer[1] == 'W') {
-                    // Set Config
-                    if (buffer[2] == '1') {
-                        // Set Kp Azimuth gain
-                        rawData = strtok_r(Data, ",", &Data);
-                        strncpy(data, rawData + 4, 10);
-                        if (isNumber(data)) {
-                            control_az.p = atof(data);
-                        }
-                    } else if (buffer[2] == '2') {
-                        // Set Ki Azimuth gain
-                        rawData = strtok_r(Data, ",", &Data);
-                        strncpy(data, rawData + 4, 10);
-                        if (isNumber(data)) {
-                            control_az.i = atof(data);
-                        }
-                    } else if (buffer[2] == '3') {
-                        // Set Kd Azimuth gain
-                        rawData = strtok_r(Data, ",", &Data);
-                        strncpy(data, rawData + 4, 10);
-                        if (isNumber(data)) {
-                            control_az.d = atof(data);
-                        }
-                    } else if (buffer[2] == '4') {
-                        // Set Kp Elevation gain
-                        rawData = strtok_r(Data, ",", &Data);
-                        strncpy(data, rawData + 4, 10);
-                        if (isNumber(data)) {
-                            control_el.p = atof(data);
-                        }
-                    } else if (buffer[2] == '5') {
-                        // Set Ki Elevation gain
-                        rawData = strtok_r(Data, ",", &Data);
-                        strncpy(data, rawData + 4, 10);
-                        if (isNumber(data)) {
-                            control_el.i = atof(data);
-                        }
-                    } else if (buffer[2] == '6') {
-                        // Set Kd Elevation gain
-                        rawData = strtok_r(Data, ",", &Data);
-                        strncpy(data, rawData + 4, 10);
-                        if (isNumber(data)) {
-                            control_el.d = atof(data);
-                        }
-                    }  else if (buffer[2] == '7') {
-                        // Set the Azimuth park position
-                        rawData = strtok_r(Data, ",", &Data);
-                        strncpy(data, rawData + 4, 10);
-                        if (isNumber(data)) {
-                            rotator.park_az = atof(data);
-                        }
-                    } else if (buffer[2] == '8') {
-                        // Set the Elevation park position
-                        rawData = strtok_r(Data, ",", &Data);
-                        strncpy(data, rawData + 4, 10);
-                        if (isNumber(data)) {
-                            rotator.park_el = atof(data);
-                        }
-                    }
-                } else if (buffer[0] == 'R' && buffer[1] == 'S'
-                        && buffer[2] == 'T') {
-                    // Custom command to test the watchdog timer routine
-                    while(1)
-                        ;
-                } else if (buffer[0] == 'R' && buffer[1] == 'B') {
-                    // Custom command to reboot the uC
-                    wdt_enable(WDTO_2S);
-                    while(1);
+#if ENABLE_BINARY
+        if (binary.proc()) {
+            // The binary protocol has the port
+            return;
+        }
+#endif
+        if (_hex_pending && passes.write()) {
+            _reply.begin("HX");
+            _reply.integer(1);
+            _reply.send();
+            _hex_pending = false;
+        }
+        // Read from serial, the lines after a HEX record wait for its write
+        while (!_hex_pending && uart0.available() > 0) {
+            parse_byte(uart0.read());
+        }
+#if ENABLE_TIMING
+        if (_dump >= 0) {
+            send_timing();
+        }
+#endif
+        if (_push_period != 0) {
+            send_push();
+        }
+    }
+
+private:
+    /** Parser states */
+    enum _parser_state {
+        token_start, token_word, token_number, token_fraction, token_skip,
+        token_tle, token_hex, token_address, token_ignore
+    };
+
+    /** Entry of the dispatch table */
+    struct _command {
+        uint16_t opcode;
+        void (*handler)(easycomm &comm);
+    };
+
+    static const _command _commands[] PROGMEM;
+
+    reply _reply;
+    _token _tokens[MAX_TOKENS];
+    uint8_t _count;
+    enum _parser_state _state;
+    bool _negative;
+    uint8_t _fraction;
+#if ENABLE_RS485
+    bool _addressed;    ///< The line has the address of this node
+    int16_t _line_node; ///< Address of the line, -1 before its digits
+#endif
+#if ENABLE_TIMING
+    int8_t _dump = -1;        ///< Histogram of the running dump, -1 if none
+    uint8_t _dump_bucket = 0; ///< Next bucket of the dump
+#endif
+    bool _hex_pending = false;  ///< A HEX record is written to EEPROM, its reply waits
+    uint32_t _push_period = 0;  ///< Period of the pushed telemetry in ms, 0 if off
+    uint32_t _push_next = 0;    ///< Time of the next record
+    int32_t _push_deadband = -1; ///< Change in mdeg that pushes a record, -1 for every period
+    int32_t _push_az = 0, _push_el = 0; ///< Position of the last record
+    uint8_t _push_status = 0, _push_error = 0; ///< Status and error of the last record
+
+    /**************************************************************************/
+    /*!
+        @brief    Feed one byte to the command parser, '\n' or '\r' ends a
+                  command line and dispatches it
+        @param    c
+                  The incoming byte
+    */
+    /**************************************************************************/
+    void parse_byte(char c) {
+#if ENABLE_RS485
+        if (!_addressed && address_byte(c)) {
+            return;
+        }
+#endif
+        if (_state == token_hex) {
+            if (c == '\n' || c == '\r') {
+                // Reply 1 once the record is written, 0 if invalid
+                if (passes.end_record()) {
+                    _hex_pending = true;
+                } else {
+                    _reply.begin("HX");
+                    _reply.integer(0);
+                    _reply.send();
                 }
-                // Reset the buffer an clean the serial buffer
-                BufferCnt = 0;
-                Serial.flush();
+                reset_line();
             } else {
-                // Fill the buffer with incoming data
-                buffer[BufferCnt] = incomingByte;
-                BufferCnt++;
+                passes.feed(c);
             }
+            return;
+        }
+        if (_state == token_start && _count == 0 && c == ':') {
+            // An Intel HEX record for the pass storage
+            _state = token_hex;
+            passes.begin_record();
+            return;
+        }
+#if ENABLE_SGP4
+        if (_state == token_tle) {
+            if (c == '\n' || c == '\r') {
+                // Reply with the number of the valid line, 0 if invalid
+                _reply.begin("TL");
+                _reply.integer(sat.end_line());
+                _reply.send();
+                reset_line();
+            } else {
+                sat.feed(c);
+            }
+            return;
+        }
+        if (_state == token_start && _count == 0 && (c == '1' || c == '2')) {
+            // A line that starts with the line number is a TLE line
+            _state = token_tle;
+            sat.begin_line(c);
+            return;
+        }
+#endif
+        if (c == '\n' || c == '\r') {
+            end_token();
+            if (_count > 0) {
+                dispatch();
+            }
+            reset_line();
+            return;
+        }
+        if (c == ' ' || c == ',') {
+            end_token();
+            return;
+        }
+        if (_state == token_start) {
+            // Start a new token, tokens beyond MAX_TOKENS are ignored
+            if (_count == MAX_TOKENS) {
+                _state = token_skip;
+                return;
+            }
+            _token *t = &_tokens[_count];
+            t->letters = 0;
+            t->has_value = false;
+            t->value = 0;
+            _negative = false;
+            _fraction = 0;
+            _state = token_word;
+        }
+        if (_state == token_skip) {
+            return;
+        }
+
+        _token *t = &_tokens[_count];
+        if (isalpha(c)) {
+            if (_state != token_word) {
+                // Letters after a number, drop the value of this token
+                t->has_value = false;
+                _state = token_skip;
+            } else if (t->letters < 2) {
+                t->word[t->letters++] = toupper(c);
+            } else if (t->letters < UINT8_MAX) {
+                t->letters++;
+            }
+        } else if (isdigit(c)) {
+            if (_state == token_word) {
+                _state = token_number;
+            }
+            t->has_value = true;
+            if (_state == token_number) {
+                t->value = t->value * 10 + (c - '0');
+                if (t->value > MAX_INTEGER) {
+                    t->has_value = false;
+                    _state = token_skip;
+                }
+            } else if (_fraction < 3) {
+                t->value = t->value * 10 + (c - '0');
+                _fraction++;
+            }
+        } else if (c == '.' && _state != token_fraction) {
+            _state = token_fraction;
+        } else if ((c == '-' || c == '+') && _state == token_word &&
+                   !t->has_value) {
+            _negative = (c == '-');
+            _state = token_number;
+        } else {
+            t->has_value = false;
+            _state = token_skip;
         }
     }
 
-private:
-    bool isNumber(char *input) {
-        for (uint16_t i = 0; input[i] != '\0'; i++) {
-            if (isalpha(input[i]))
-                return false;
+    /**************************************************************************/
+    /*!
+        @brief    Close the current token and scale its value to thousandths
+    */
+    /**************************************************************************/
+    void end_token() {
+        if (_state == token_start) {
+            return;
+        }
+        if (_count < MAX_TOKENS) {
+            _token *t = &_tokens[_count];
+            for (; _fraction < 3; _fraction++) {
+                t->value *= 10;
+            }
+            if (_negative) {
+                t->value = -t->value;
+            }
+            _count++;
+        }
+        _state = token_start;
+    }
+
+    void reset_line() {
+        _count = 0;
+        _state = token_start;
+#if ENABLE_RS485
+        _addressed = false;
+#endif
+    }
+
+#if ENABLE_RS485
+    /**************************************************************************/
+    /*!
+        @brief    Take the address at the start of a line on the RS485 bus,
+                  "#<node>" before the command, e.g. "#2 AZ". The lines of
+                  the other nodes and the lines without an address are
+                  ignored up to their end. Node 0 is a broadcast, the
+                  command runs on every node without a reply
+        @param    c
+                  The incoming byte
+        @return   True if the byte is taken, false if it starts the command
+    */
+    /**************************************************************************/
+    bool address_byte(char c) {
+        if (c == '\n' || c == '\r') {
+            reset_line();
+            return true;
+        }
+        if (_state == token_start) {
+            _state = c == '#' ? token_address : token_ignore;
+            _line_node = -1;
+            return true;
+        }
+        if (_state != token_address) {
+            return true;
+        }
+        if (isdigit(c)) {
+            if (_line_node < 1000) {
+                _line_node = (_line_node < 0 ? 0 : _line_node * 10) + c - '0';
+            }
+            return true;
+        }
+        if (_line_node != RS485_NODE && _line_node != 0) {
+            _state = token_ignore;
+            return true;
+        }
+        _addressed = true;
+        _reply.node(_line_node);
+        _state = token_start;
+        return false;
+    }
+#endif
+
+    /**************************************************************************/
+    /*!
+        @brief    Find the handler of the command line in the dispatch table
+    */
+    /**************************************************************************/
+    void dispatch() {
+        if (_tokens[0].letters < 2) {
+            return;
+        }
+        uint16_t opcode = OPCODE(_tokens[0].word[0], _tokens[0].word[1]);
+        for (const _command *cmd = _commands; ; cmd++) {
+            uint16_t entry = pgm_read_word(&cmd->opcode);
+            if (entry == 0) {
+                return;
+            }
+            if (entry == opcode) {
+                void (*handler)(easycomm &comm);
+                handler = (void (*)(easycomm &))pgm_read_ptr(&cmd->handler);
+                handler(*this);
+                return;
+            }
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the token of a command line
+        @param    i
+                  The index of the token
+        @return   The token, or an empty token if the line is shorter
+    */
+    /**************************************************************************/
+    const _token &token(uint8_t i) {
+        static const _token empty = { { 0, 0 }, 0, false, 0 };
+        return i < _count ? _tokens[i] : empty;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the number of a command, written either in the
+                  command token, e.g. "IP1", or in the next one, e.g. "CR 1"
+        @return   The integer part of the number, -1 if it is missing
+    */
+    /**************************************************************************/
+    int16_t argument() {
+        if (token(0).has_value) {
+            return token(0).value / 1000;
+        } else if (token(1).has_value && token(1).letters == 0) {
+            return token(1).value / 1000;
+        }
+        return -1;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Send the current absolute position of both axis in deg
+    */
+    /**************************************************************************/
+    void send_position() {
+        // The azimuth is the cable position, send its direction
+        int32_t az = control_az.input % MDEG_TURN;
+        _reply.begin("AZ");
+        _reply.milli(az < 0 ? az + MDEG_TURN : az, 1);
+        _reply.text(" EL");
+        _reply.milli(control_el.input, 1);
+        _reply.send();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Push the telemetry record when it is due, "ST<trajectory
+                  time in s>,<az>,<el>,<status>,<error>,<load az>,<load
+                  el>,<temperature>". With a deadband the record is only
+                  sent when the position moved beyond it or the status or
+                  error changed. The record waits for room in the TX ring,
+                  so it never blocks the loop and leaves room for the
+                  replies
+    */
+    /**************************************************************************/
+    void send_push() {
+        uint32_t now = millis();
+        if ((int32_t)(now - _push_next) < 0) {
+            return;
+        }
+        bool changed = _push_deadband < 0 ||
+                       labs(control_az.input - _push_az) > _push_deadband ||
+                       labs(control_el.input - _push_el) > _push_deadband ||
+                       rotator.rotator_status != _push_status ||
+                       rotator.rotator_error != _push_error;
+        if (changed) {
+            if (uart0.tx_free() < 2 * REPLY_SIZE) {
+                return;
+            }
+            int32_t az = control_az.input % MDEG_TURN;
+            _reply.begin("ST");
+            _reply.scaled(track.now(), 3);
+            _reply.text(",");
+            _reply.milli(az < 0 ? az + MDEG_TURN : az, 2);
+            _reply.text(",");
+            _reply.milli(control_el.input, 2);
+            _reply.text(",");
+            _reply.integer(rotator.rotator_status);
+            _reply.text(",");
+            _reply.integer(rotator.rotator_error);
+            _reply.text(",");
+            _reply.integer(control_az.load);
+            _reply.text(",");
+            _reply.integer(control_el.load);
+            _reply.text(",");
+            _reply.integer(rotator.inside_temperature);
+            _reply.send();
+            _push_az = control_az.input;
+            _push_el = control_el.input;
+            _push_status = rotator.rotator_status;
+            _push_error = rotator.rotator_error;
+        }
+        // Keep the records on the period, unless the loop fell behind by
+        // a whole period, e.g. the homing
+        _push_next += _push_period;
+        if ((int32_t)(now - _push_next) >= 0) {
+            _push_next = now + _push_period;
+        }
+    }
+
+#if ENABLE_TIMING
+    /**************************************************************************/
+    /*!
+        @brief    Send the next lines of a histogram dump, as many as the TX
+                  ring takes, "TM<h>,<lowest time of the bucket in
+                  us>,<samples>" for the buckets with samples and then
+                  "TM<h>,max,<longest time in us>". The sent samples are
+                  taken out of the histogram
+    */
+    /**************************************************************************/
+    void send_timing() {
+        while (_dump_bucket < TIMING_BUCKETS) {
+            uint16_t count = timing.get(_dump, _dump_bucket);
+            if (count != 0) {
+                _reply.begin("TM");
+                _reply.integer(_dump);
+                _reply.text(",");
+                _reply.milli(timing_stats::lower(_dump_bucket) * 500, 1);
+                _reply.text(",");
+                _reply.integer(count);
+                if (!_reply.send()) {
+                    return;
+                }
+                timing.take(_dump, _dump_bucket, count);
+            }
+            _dump_bucket++;
+        }
+        _reply.begin("TM");
+        _reply.integer(_dump);
+        _reply.text(",max,");
+        _reply.integer(timing.longest(_dump) / 2);
+        if (_reply.send()) {
+            timing.reset_longest(_dump);
+            _dump = -1;
+        }
+    }
+#endif
+
+    static void cmd_az(easycomm &comm) {
+        const _token &el = comm.token(1);
+        bool el_value = el.has_value && el.word[0] == 'E' &&
+                        el.word[1] == 'L';
+        if (!comm.token(0).has_value && !el_value) {
+            // Send current absolute position in deg
+            comm.send_position();
+            return;
+        }
+        if (rotator.control_mode == speed) {
+            // The set points of the velocity mode are not current
+            hold_position();
+        }
+        rotator.control_mode = position;
+        // The FL1 flag, e.g. "AZ10 EL80 FL1", points in the flipped geometry
+        bool flipped = false;
+        for (uint8_t i = 1; i < MAX_TOKENS; i++) {
+            const _token &t = comm.token(i);
+            if (t.has_value && t.word[0] == 'F' && t.word[1] == 'L') {
+                flipped = t.value != 0;
+            }
+        }
+        if (comm.token(0).has_value) {
+            // Get the absolute position in mdeg for azimuth, on the turn
+            // of the cable wrap that the axis reaches first
+            int32_t az = comm.token(0).value;
+            if (flipped) {
+                az += 180000L;
+            }
+            control_az.setpoint = wrap.shortest(az, control_az.input,
+                                                control_az.speed);
+        }
+        if (el_value) {
+            // Get the absolute position in mdeg for elevation
+            control_el.setpoint = flipped ? 180000L - el.value : el.value;
+        }
+    }
+
+    static void cmd_el(easycomm &comm) {
+        // Get the absolute position in mdeg for elevation
+        if (comm.token(0).has_value) {
+            if (rotator.control_mode == speed) {
+                // The set points of the velocity mode are not current
+                hold_position();
+            }
+            rotator.control_mode = position;
+            control_el.setpoint = comm.token(0).value;
+        }
+    }
+
+    static void cmd_velocity(easycomm &comm) {
+        const _token &cmd = comm.token(0);
+        if (!cmd.has_value) {
+            return;
+        }
+        // Speed in mdeg/s, the token is in thousandths
+        int32_t value = cmd.value / 1000;
+        switch (cmd.word[1]) {
+        case 'U':
+            // Elevation increase speed
+            set_velocity(control_el, value);
+            break;
+        case 'D':
+            // Elevation decrease speed
+            set_velocity(control_el, -value);
+            break;
+        case 'L':
+            // Azimuth increase speed
+            set_velocity(control_az, value);
+            break;
+        case 'R':
+            // Azimuth decrease speed
+            set_velocity(control_az, -value);
+            break;
+        }
+    }
+
+    static void cmd_sync(easycomm &comm) {
+        // Set the trajectory time in s, e.g. "TS120.5", or get it
+        if (comm.token(0).has_value && comm.token(0).value >= 0) {
+            track.sync(comm.token(0).value);
+        }
+        comm._reply.begin("TS");
+        comm._reply.scaled(track.now(), 3);
+        comm._reply.send();
+    }
+
+    static void cmd_subscribe(easycomm &comm) {
+        // Push the telemetry every period in s, e.g. "SU0.5", or only on a
+        // change beyond a deadband in deg checked at the period, e.g.
+        // "SU0.1 DB0.5", "SU0" stops it. Reply with the period
+        const _token &cmd = comm.token(0);
+        if (cmd.has_value) {
+            comm._push_period = cmd.value > 0 ? cmd.value : 0;
+            if (comm._push_period != 0 &&
+                comm._push_period < PUSH_MIN_PERIOD) {
+                comm._push_period = PUSH_MIN_PERIOD;
+            }
+            comm._push_deadband = -1;
+            for (uint8_t i = 1; i < MAX_TOKENS; i++) {
+                const _token &t = comm.token(i);
+                if (t.has_value && t.word[0] == 'D' && t.word[1] == 'B') {
+                    comm._push_deadband = labs(t.value);
+                }
+            }
+            // The first record is due now, in any case
+            comm._push_next = millis();
+            comm._push_status = 0;
+        }
+        comm._reply.begin("SU");
+        comm._reply.scaled(comm._push_period, 3);
+        comm._reply.send();
+    }
+
+    static void cmd_track_point(easycomm &comm) {
+        // Queue a trajectory sample, e.g. "TP125.0 AZ10.5 EL20.1", reply
+        // with the free places of the queue or -1 if it is rejected
+        const _token &t = comm.token(0);
+        const _token &az = comm.token(1);
+        const _token &el = comm.token(2);
+        bool valid = t.has_value && t.value >= 0 &&
+                     az.has_value && az.word[0] == 'A' && az.word[1] == 'Z' &&
+                     el.has_value && el.word[0] == 'E' && el.word[1] == 'L';
+        comm._reply.begin("TP");
+        if (valid && track.add(t.value, az.value, el.value)) {
+            rotator.control_mode = tracking;
+            comm._reply.integer(track.free());
+        } else {
+            comm._reply.integer(-1);
+        }
+        comm._reply.send();
+    }
+
+    static void cmd_track_clear(easycomm &comm) {
+        // Remove the trajectory samples and hold the current position
+        (void)comm;
+        track.clear();
+        if (rotator.control_mode == tracking) {
+            rotator.control_mode = position;
+            hold_position();
+        }
+    }
+
+    static void cmd_time(easycomm &comm) {
+        // Set the UTC, e.g. "UT24291 43200.125" for 2024, day 291 at
+        // 12:00:00.125, or get it
+        const _token &ms = comm.token(1);
+        if (comm.token(0).has_value) {
+            if (!ms.has_value || ms.letters != 0 || ms.value < 0 ||
+                !utc_clock.set(comm.token(0).value / 1000, ms.value)) {
+                return;
+            }
+        }
+        int32_t yyddd;
+        uint32_t now;
+        comm._reply.begin("UT");
+        if (utc_clock.get(&yyddd, &now)) {
+            comm._reply.integer(yyddd);
+            comm._reply.text(" ");
+            comm._reply.scaled(now, 3);
+        } else {
+            comm._reply.integer(-1);
+        }
+        comm._reply.send();
+    }
+
+    static void cmd_passes(easycomm &comm) {
+        // Get the number of stored passes
+        comm._reply.begin("PL");
+        comm._reply.integer(passes.count());
+        comm._reply.send();
+    }
+
+#if ENABLE_SGP4
+    static void cmd_orbit(easycomm &comm) {
+        // Start the on-board tracking of the TLE, reply 1 if it started
+        bool started = sat.start();
+        if (started) {
+            rotator.control_mode = prediction;
+        }
+        comm._reply.begin("OT");
+        comm._reply.integer(started);
+        comm._reply.send();
+    }
+#endif
+
+    static void cmd_stop(easycomm &comm) {
+        // Stop Moving
+        track.clear();
+        rotator.control_mode = position;
+        comm.send_position();
+        hold_position();
+    }
+
+    static void cmd_reset(easycomm &comm) {
+        // Reset the rotator, go to home position
+        if (comm.token(0).letters == 5) {
+            comm.send_position();
+            rotator.homing_flag = false;
         }
-        return true;
     }
+
+    static void cmd_park(easycomm &comm) {
+        // Park the rotator
+        if (comm.token(0).letters == 4) {
+            rotator.control_mode = position;
+            comm.send_position();
+            control_az.setpoint = rotator.park_az;
+            control_el.setpoint = rotator.park_el;
+        }
+    }
+
+    static void cmd_version(easycomm &comm) {
+        // Get the version if rotator controller
+        comm._reply.begin("VE");
+        comm._reply.text("SatNOGS-v2.2");
+        comm._reply.send();
+    }
+
+    static void cmd_input(easycomm &comm) {
+        reply &r = comm._reply;
+        int16_t reg = comm.argument();
+        switch (reg) {
+        case 0:
+            // Get the inside temperature
+            r.begin("IP0,");
+            r.integer(rotator.inside_temperature);
+            break;
+        case 1:
+            // Get the status of end-stop, azimuth
+            r.begin("IP1,");
+            r.integer(rotator.switch_az);
+            break;
+        case 2:
+            // Get the status of end-stop, elevation
+            r.begin("IP2,");
+            r.integer(rotator.switch_el);
+            break;
+        case 3:
+            // Get the current position of azimuth in deg
+            r.begin("IP3,");
+            r.milli(control_az.input, 2);
+            break;
+        case 4:
+            // Get the current position of elevation in deg
+            r.begin("IP4,");
+            r.milli(control_el.input, 2);
+            break;
+        case 5:
+            // Get the load of azimuth, in range of 0-1023
+            r.begin("IP5,");
+            r.integer(control_az.load);
+            break;
+        case 6:
+            // Get the load of elevation, in range of 0-1023
+            r.begin("IP6,");
+            r.integer(control_el.load);
+            break;
+        case 7:
+            // Get the speed of azimuth in deg/s
+            r.begin("IP7,");
+            r.milli(control_az.speed, 2);
+            break;
+        case 8:
+            // Get the speed of elevation in deg/s
+            r.begin("IP8,");
+            r.milli(control_el.speed, 2);
+            break;
+#if ENABLE_ENCODER
+        case 9:
+            // Get the encoder minus the step position of azimuth in deg
+            r.begin("IP9,");
+            r.milli(encoder_az.error(), 2);
+            break;
+        case 10:
+            // Get the encoder minus the step position of elevation in deg
+            r.begin("IP10,");
+            r.milli(encoder_el.error(), 2);
+            break;
+#endif
+        default:
+            return;
+        }
+        r.send();
+    }
+
+    static void cmd_status(easycomm &comm) {
+        // Get the status of rotator
+        comm._reply.begin("GS");
+        comm._reply.integer(rotator.rotator_status);
+        comm._reply.send();
+    }
+
+    static void cmd_error(easycomm &comm) {
+        // Get the error of rotator
+        comm._reply.begin("GE");
+        comm._reply.integer(rotator.rotator_error);
+        comm._reply.send();
+    }
+
+    static void cmd_read_config(easycomm &comm) {
+        // Get Configuration of rotator
+        reply &r = comm._reply;
+        int16_t reg = comm.argument();
+        if (reg < 1) {
+            return;
+        }
+        r.begin("");
+        r.integer(reg);
+        r.text(",");
+        switch (reg) {
+        case 1:
+            // Get Kp Azimuth gain
+            r.fixed(control_az.p, 2);
+            break;
+        case 2:
+            // Get Ki Azimuth gain
+            r.fixed(control_az.i, 2);
+            break;
+        case 3:
+            // Get Kd Azimuth gain
+            r.fixed(control_az.d, 2);
+            break;
+        case 4:
+            // Get Kp Elevation gain
+            r.fixed(control_el.p, 2);
+            break;
+        case 5:
+            // Get Ki Elevation gain
+            r.fixed(control_el.i, 2);
+            break;
+        case 6:
+            // Get Kd Elevation gain
+            r.fixed(control_el.d, 2);
+            break;
+        case 7:
+            // Get Azimuth park position
+            r.milli(rotator.park_az, 2);
+            break;
+        case 8:
+            // Get Elevation park position
+            r.milli(rotator.park_el, 2);
+            break;
+        case 9:
+            // Get control mode
+            r.integer(rotator.control_mode);
+            break;
+        case 10:
+            // Get coordinated motion of both axis
+            r.integer(rotator.coordinated);
+            break;
+        case 11:
+            // Get motion profile
+            r.integer(rotator.profile);
+            break;
+        case 12:
+            // Get jerk limit of S-curve profile in steps/s^3
+            r.integer(rotator.jerk);
+            break;
+        case 16:
+            // Get autonomous execution of the stored passes
+            r.integer(rotator.autonomous);
+            break;
+        case 17:
+            // Get flip planner of the zenith crossings
+            r.integer(rotator.flip);
+            break;
+        case 18:
+            // Get backlash of the azimuth gear in deg
+            r.milli(step2mdeg(stepper_az.backlash()), 3);
+            break;
+        case 19:
+            // Get backlash of the elevation gear in deg
+            r.milli(step2mdeg(stepper_el.backlash()), 3);
+            break;
+#if ENABLE_SGP4
+        case 13:
+            // Get station latitude in deg
+            r.fixed(sat.station().latitude(), 3);
+            break;
+        case 14:
+            // Get station longitude in deg
+            r.fixed(sat.station().longitude(), 3);
+            break;
+        case 15:
+            // Get station altitude in m
+            r.fixed(sat.station().altitude(), 0);
+            break;
+#endif
+        default:
+            return;
+        }
+        r.send();
+    }
+
+    static void cmd_write_config(easycomm &comm) {
+        // Set Config, e.g. "CW1,8.5"
+        const _token &arg = comm.token(1);
+        if (!comm.token(0).has_value || !arg.has_value || arg.letters != 0) {
+            return;
+        }
+        double value = arg.value / 1000.0;
+        switch (comm.token(0).value / 1000) {
+        case 1:
+            // Set Kp Azimuth gain
+            control_az.p = value;
+            break;
+        case 2:
+            // Set Ki Azimuth gain
+            control_az.i = value;
+            break;
+        case 3:
+            // Set Kd Azimuth gain
+            control_az.d = value;
+            break;
+        case 4:
+            // Set Kp Elevation gain
+            control_el.p = value;
+            break;
+        case 5:
+            // Set Ki Elevation gain
+            control_el.i = value;
+            break;
+        case 6:
+            // Set Kd Elevation gain
+            control_el.d = value;
+            break;
+        case 7:
+            // Set the Azimuth park position, in mdeg
+            rotator.park_az = arg.value;
+            break;
+        case 8:
+            // Set the Elevation park position, in mdeg
+            rotator.park_el = arg.value;
+            break;
+        case 10:
+            // Set coordinated motion of both axis, 0 or 1
+            rotator.coordinated = (arg.value != 0);
+            break;
+        case 11:
+            // Set motion profile, trapezoidal = 0 or S-curve = 1
+            rotator.profile = arg.value != 0 ? s_curve : trapezoidal;
+            break;
+        case 12:
+            // Set jerk limit of S-curve profile in steps/s^3
+            if (arg.value > 0) {
+                rotator.jerk = arg.value / 1000;
+            }
+            break;
+        case 16:
+            // Set autonomous execution of the stored passes, 0 or 1
+            rotator.autonomous = (arg.value != 0);
+            break;
+        case 17:
+            // Set flip planner of the zenith crossings, 0 or 1
+            rotator.flip = (arg.value != 0);
+            break;
+        case 18:
+            // Set backlash of the azimuth gear in deg
+            if (arg.value >= 0 && arg.value <= BACKLASH_MAX) {
+                stepper_az.set_backlash(mdeg2step(arg.value));
+            }
+            break;
+        case 19:
+            // Set backlash of the elevation gear in deg
+            if (arg.value >= 0 && arg.value <= BACKLASH_MAX) {
+                stepper_el.set_backlash(mdeg2step(arg.value));
+            }
+            break;
+#if ENABLE_SGP4
+        case 13:
+            // Set station latitude in deg
+            sat.set_station(value, sat.station().longitude(),
+                            sat.station().altitude());
+            break;
+        case 14:
+            // Set station longitude in deg, east positive
+            sat.set_station(sat.station().latitude(), value,
+                            sat.station().altitude());
+            break;
+        case 15:
+            // Set station altitude in m
+            sat.set_station(sat.station().latitude(),
+                            sat.station().longitude(), value);
+            break;
+#endif
+        }
+    }
+
+    static void cmd_test_wdt(easycomm &comm) {
+        // Custom command to test the watchdog timer routine, a busy wait
+        // that never ends, it reads the clock as a wait for the hardware
+        if (comm.token(0).letters == 3) {
+            for (;;) {
+                millis();
+            }
+        }
+    }
+
+    static void cmd_post_mortem(easycomm &comm) {
+        // Get the post-mortem of the last watchdog reset, "PM1" the state
+        // of the current run, e.g. "PM1,1,3621,2047,2047,0,0,1,1", the
+        // resets, the stage, the time in s, the time in the round and in
+        // the stage at the timeout and the longest run of each stage in
+        // ms, or "PM0" if there was no watchdog reset. Reading the
+        // post-mortem clears it and wdt_error
+        reply &r = comm._reply;
+        _deadline_record record;
+        r.begin("PM");
+        if (comm.argument() == 1) {
+            deadline.snapshot(&record);
+        } else if (!deadline.saved(&record)) {
+            r.integer(0);
+            r.send();
+            return;
+        } else {
+            deadline.clear();
+            if (rotator.rotator_error == wdt_error) {
+                rotator.rotator_error = no_error;
+            }
+        }
+        r.integer(record.resets);
+        r.text(",");
+        r.integer(record.stage);
+        r.text(",");
+        r.integer(record.time / 1000);
+        r.text(",");
+        r.integer(record.in_loop);
+        r.text(",");
+        r.integer(record.in_stage);
+        for (uint8_t i = 0; i < DEADLINE_STAGES; i++) {
+            r.text(",");
+            r.integer(record.worst[i]);
+        }
+        r.send();
+    }
+
+#if ENABLE_TIMING
+    static void cmd_timing(easycomm &comm) {
+        // Dump and reset a timing histogram, easycomm_proc sends the lines
+        int16_t h = comm.argument();
+        if (h < 0 || h >= TIMING_COUNT || comm._dump >= 0) {
+            return;
+        }
+        comm._dump = h;
+        comm._dump_bucket = 0;
+    }
+#endif
+
+#if ENABLE_BINARY
+    static void cmd_binary(easycomm &comm) {
+        // Switch to the binary protocol at a baudrate, e.g. "BP115200",
+        // reply with the baudrate at the current one, or -1
+        const _token &cmd = comm.token(0);
+        uint32_t baudrate = cmd.has_value && cmd.value > 0 ?
+                            cmd.value / 1000 : 0;
+        comm._reply.begin("BP");
+        if (binary.open(baudrate, BAUDRATE)) {
+            comm._reply.integer(baudrate);
+        } else {
+            comm._reply.integer(-1);
+        }
+        comm._reply.send();
+    }
+#endif
+
+    static void cmd_reboot(easycomm &comm) {
+        // Custom command to reboot the uC, it is a watchdog reset but
+        // leaves no post-mortem
+        (void)comm;
+        deadline.clear();
+        wdt_enable(WDTO_2S);
+        while(1);
+    }
+};
+
+/** Dispatch table, the most frequent commands first, ends with opcode 0 */
+const easycomm::_command easycomm::_commands[] PROGMEM = {
+    { OPCODE('A', 'Z'), easycomm::cmd_az },
+    { OPCODE('E', 'L'), easycomm::cmd_el },
+    { OPCODE('T', 'P'), easycomm::cmd_track_point },
+    { OPCODE('G', 'S'), easycomm::cmd_status },
+    { OPCODE('G', 'E'), easycomm::cmd_error },
+    { OPCODE('I', 'P'), easycomm::cmd_input },
+    { OPCODE('S', 'A'), easycomm::cmd_stop },
+    { OPCODE('V', 'U'), easycomm::cmd_velocity },
+    { OPCODE('V', 'D'), easycomm::cmd_velocity },
+    { OPCODE('V', 'L'), easycomm::cmd_velocity },
+    { OPCODE('V', 'R'), easycomm::cmd_velocity },
+    { OPCODE('V', 'E'), easycomm::cmd_version },
+    { OPCODE('R', 'E'), easycomm::cmd_reset },
+    { OPCODE('P', 'A'), easycomm::cmd_park },
+    { OPCODE('T', 'S'), easycomm::cmd_sync },
+    { OPCODE('T', 'C'), easycomm::cmd_track_clear },
+#if !ENABLE_RS485
+    { OPCODE('S', 'U'), easycomm::cmd_subscribe },
+#endif
+    { OPCODE('U', 'T'), easycomm::cmd_time },
+    { OPCODE('P', 'L'), easycomm::cmd_passes },
+#if ENABLE_SGP4
+    { OPCODE('O', 'T'), easycomm::cmd_orbit },
+#endif
+    { OPCODE('C', 'R'), easycomm::cmd_read_config },
+    { OPCODE('C', 'W'), easycomm::cmd_write_config },
+    { OPCODE('R', 'S'), easycomm::cmd_test_wdt },
+    { OPCODE('R', 'B'), easycomm::cmd_reboot },
+    { OPCODE('P', 'M'), easycomm::cmd_post_mortem },
+#if ENABLE_TIMING
+    { OPCODE('T', 'M'), easycomm::cmd_timing },
+#endif
+#if ENABLE_BINARY
+    { OPCODE('B', 'P'), easycomm::cmd_binary },
+#endif
+    { 0, NULL }
 };
 
 #endif /* LIBRARIES_EASYCOMM_H_ */
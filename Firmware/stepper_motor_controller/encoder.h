@@ -0,0 +1,220 @@
+/*!
+* @file encoder.h
+*
+* It is the step loss monitor, ENABLE_ENCODER. It compares the AS5601
+* encoder of each axis with the step count and corrects the steps that the
+* motor missed, e.g. from wind or ice. sensors.h queues the readings.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef ENCODER_H_
+#define ENCODER_H_
+
+#include "as5601.h"
+#include "i2c_mux.h"
+#include "stepper.h"
+#include "units.h"
+
+#define PCA9540_ID    0x70 ///< I2C address of the multiplexer of the encoders
+#define PCA9540_CH0   0x04 ///< Multiplexer channel of the azimuth encoder
+#define PCA9540_CH1   0x05 ///< Multiplexer channel of the elevation encoder
+#define ENC_RATIO     2    ///< Turns of the encoder per turn of the axis
+#define ENC_PERIOD    100  ///< Period of the checks in ms
+#define ENC_THRESHOLD 500L ///< Difference of the encoder and the steps that is step loss in mdeg
+#define ENC_CONFIRM   2    ///< Checks in a row above the threshold before a correction
+#define ENC_RETRIES   3    ///< Corrections in a row, without a check within the threshold, that are not recoverable
+#define ENC_FAILS     5    ///< Checks in a row without a reading before the error is not recoverable
+
+i2c_mux pca9540(PCA9540_ID, PCA9540_CH0, PCA9540_CH1);
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the step loss monitor of one axis.
+              The step count is the position, the encoder confirms it. The
+              interrupt at the end of a reading takes the step count, so
+              the reading and the count are from the same time. A
+              difference above ENC_THRESHOLD in ENC_CONFIRM checks in a row
+              moves the step count to the encoder and the step generator
+              makes up the missed steps. It is not recoverable when the
+              encoder does not answer, or when the difference is above the
+              threshold again at every check after the corrections, e.g.
+              the axis is stuck
+*/
+/**************************************************************************/
+class step_monitor {
+public:
+    step_monitor(stepper &axis, uint8_t channel) : _axis(axis) {
+        _channel = channel;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the encoder
+    */
+    /**************************************************************************/
+    void init() {
+        _encoder.Begin();
+        _encoder.set_gear_ratio(ENC_RATIO);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Queue the reading of the encoder, after the change of the
+                  multiplexer channel
+        @return   False if it could not be queued
+    */
+    /**************************************************************************/
+    bool request() {
+        return !_encoder.busy() && pca9540.set_channel(_channel) &&
+               _encoder.request(latch, this);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if the reading is still queued
+        @return   True if queued
+    */
+    /**************************************************************************/
+    bool busy() {
+        return _encoder.busy();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Take the finished reading, it is dropped if the step count
+                  changed meanwhile by a correction or the homing
+    */
+    /**************************************************************************/
+    void collect() {
+        int32_t angle = _angle;
+        bool valid_angle = pca9540.selected(_channel) &&
+                           valid(_encoder.get_pos(&angle));
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (valid_angle && _latched_epoch == _epoch) {
+                _angle = angle;
+                _angle_steps = _latched_steps;
+                _fresh = true;
+            }
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the encoder to the step count of the last reading, at
+                  the home position
+        @return   True if there is a reading of the encoder
+    */
+    /**************************************************************************/
+    bool zero() {
+        _over = 0;
+        _retries = 0;
+        _fails = 0;
+        if (!_fresh) {
+            return false;
+        }
+        _fresh = false;
+        _encoder.set_zero(_angle, step2mdeg(_angle_steps));
+        _epoch++;
+        return true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Drop the readings, the step count was set, e.g. by the
+                  homing
+    */
+    /**************************************************************************/
+    void reset() {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _fresh = false;
+            _epoch++;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Compare the last reading of the encoder with the step count
+                  and correct the step count
+        @return   False if the error is not recoverable
+    */
+    /**************************************************************************/
+    bool check() {
+        if (!_fresh) {
+            if (++_fails < ENC_FAILS) {
+                return true;
+            }
+            _fails = 0;
+            return false;
+        }
+        _fresh = false;
+        _fails = 0;
+        _error = _angle - step2mdeg(_angle_steps);
+        if (labs(_error) <= ENC_THRESHOLD) {
+            _over = 0;
+            _retries = 0;
+            return true;
+        }
+        if (++_over < ENC_CONFIRM) {
+            return true;
+        }
+        _over = 0;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _axis.correct(mdeg2step(_error));
+            _epoch++;
+        }
+        if (++_retries <= ENC_RETRIES) {
+            return true;
+        }
+        // The next run starts from the corrected step count
+        _retries = 0;
+        return false;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the difference of the encoder and the steps at the last
+                  check
+        @return   Difference in mdeg
+    */
+    /**************************************************************************/
+    int32_t error() {
+        return _error;
+    }
+
+private:
+    stepper &_axis;
+    AS5601 _encoder;
+    uint8_t _channel;
+    int32_t _error = 0;
+    int32_t _angle = 0;                 ///< Last reading in mdeg
+    int32_t _angle_steps = 0;           ///< Step count of the last reading
+    bool _fresh = false;                ///< The last reading is not checked
+    volatile uint8_t _epoch = 0;        ///< Changes of the step count
+    volatile int32_t _latched_steps = 0;
+    volatile uint8_t _latched_epoch = 0;
+    uint8_t _over = 0, _retries = 0, _fails = 0;
+
+    static bool valid(uint8_t status) {
+        return (status & AS5601_MD) && !(status & (AS5601_ML | AS5601_MH));
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    End of a reading, called from the TWI interrupt
+        @param    t
+                  The reading, its argument is the monitor
+    */
+    /**************************************************************************/
+    static void latch(twi_transfer &t) {
+        step_monitor &m = *(step_monitor *)t.arg;
+        m._latched_steps = m._axis.position();
+        m._latched_epoch = m._epoch;
+    }
+};
+
+step_monitor encoder_az(stepper_az, PCA9540_CH0);
+step_monitor encoder_el(stepper_el, PCA9540_CH1);
+
+#endif /* ENCODER_H_ */
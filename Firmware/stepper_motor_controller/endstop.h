@@ -10,6 +10,8 @@
 #ifndef ENDSTOP_H_
 #define ENDSTOP_H_
 
+#include "hal.h"
+
 /**************************************************************************/
 /*!
     @brief    Class that functions for interacting with end-stop.
@@ -49,6 +51,26 @@ public:
             return false;
     }
 
+    /**************************************************************************/
+    /*!
+        @brief    Get the pin of end-stop
+        @return   The arduino pin
+    */
+    /**************************************************************************/
+    uint8_t pin() {
+        return _pin;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the level of the triggered end-stop
+        @return   HIGH or LOW
+    */
+    /**************************************************************************/
+    bool level() {
+        return _default_state;
+    }
+
 private:
     uint8_t _pin;
     bool _default_state;
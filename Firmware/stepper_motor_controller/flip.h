@@ -0,0 +1,206 @@
+/*!
+* @file flip.h
+*
+* It is the planner of the flipped geometry, it uses the elevation range
+* beyond 90 deg to cross the zenith without the azimuth swing.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef FLIP_H_
+#define FLIP_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#define FLIP_MIN_EL 60000L ///< Lowest elevation of a zenith crossing in mdeg
+#define FLIP_PEAK   2.0    ///< Peak azimuth speed of a crossing, of the rate
+#define FLIP_RAD    (M_PI / 180000) ///< Radians of a mdeg
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the flipped geometry. The direction
+              az, el is also reached at az + 180, 180 - el. Near the zenith
+              the azimuth of a high pass swings by 180 deg in seconds.
+              When the swing would peak above FLIP_PEAK times the rate, the
+              azimuth set point turns to the vertical plane of the pass at
+              the rate and the elevation follows the pass across the
+              zenith, in the vertical plane of the azimuth set point. The
+              pointing error is about the distance of the pass from the
+              zenith. After the crossing the pass continues
+              in the flipped geometry. Out of a crossing the geometry
+              closest to the last set point is kept, so the set points
+              stay continuous
+*/
+/**************************************************************************/
+class flip_planner {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the azimuth speed the rotator follows, it is also the
+                  speed of the azimuth set point during a crossing
+        @param    rate
+                  Speed in mdeg/s
+        @param    period
+                  Period of the plan calls in ms
+    */
+    /**************************************************************************/
+    void set_rate(float rate, uint16_t period) {
+        _rate = rate;
+        _step = rate * period / 1000;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Forget the last set point, the next pass starts in the
+                  normal geometry
+    */
+    /**************************************************************************/
+    void reset() {
+        _started = false;
+        _cross = false;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Map a direction of the pass to the set points of the
+                  rotator
+        @param    az
+                  Azimuth in mdeg, unwrapped, the azimuth set point on
+                  return
+        @param    el
+                  Elevation in mdeg, 0-90 deg, the elevation set point on
+                  return, 0-180 deg
+        @param    v_az
+                  Azimuth speed in mdeg/s, of the set point on return
+        @param    v_el
+                  Elevation speed in mdeg/s, of the set point on return
+    */
+    /**************************************************************************/
+    void plan(int32_t *az, int32_t *el, float *v_az, float *v_el) {
+        if (!_started) {
+            _last = *az;
+            _started = true;
+        }
+        float x, y, dx, dy;
+        if (!_cross && *el >= FLIP_MIN_EL && *v_el > 0) {
+            // A straight pass keeps p x dp near the zenith, the azimuth
+            // speed peaks at |dp|^2 / |p x dp|
+            project(*az, *el, *v_az, *v_el, &x, &y, &dx, &dy);
+            float dp = dx * dx + dy * dy;
+            if (dp > FLIP_PEAK * _rate * FLIP_RAD * fabs(x * dy - y * dx)) {
+                // The rotator can not follow the swing
+                _cross = true;
+                _ref = _last;
+            }
+        }
+        if (_cross) {
+            int32_t a = *az;
+            nearest(_ref, &a);
+            int32_t step = a - _ref;
+            bool swing = *v_el > 0 || fabs(*v_az) > _rate;
+            if (!swing && labs(step) <= _step) {
+                // The azimuth caught up with the pass, follow it again
+                _cross = false;
+            } else {
+                if (swing) {
+                    // Turn to the vertical plane of the pass instead
+                    project(*az, *el, *v_az, *v_el, &x, &y, &dx, &dy);
+                    a = lround(atan2(dx, dy) / FLIP_RAD);
+                    nearest(_ref, &a);
+                    step = a - _ref;
+                }
+                step = step > _step ? _step : step < -_step ? -_step : step;
+                _ref += step;
+                cross(az, el, v_az, v_el, step > 0 ? _rate : step < 0 ?
+                      -_rate : 0);
+                return;
+            }
+        }
+        if (nearest(_last, az)) {
+            *el = 180000L - *el;
+            *v_el = -*v_el;
+        }
+        _last = *az;
+    }
+
+private:
+    float _rate = 0;
+    int32_t _step = 0;
+    int32_t _last, _ref;
+    bool _started = false, _cross = false;
+
+    /**************************************************************************/
+    /*!
+        @brief    Choose the geometry whose azimuth is closest to a reference
+        @param    ref
+                  Reference azimuth in mdeg, unwrapped
+        @param    az
+                  Azimuth in mdeg, the chosen azimuth on return, within
+                  90 deg of the reference
+        @return   True if the flipped geometry is chosen
+    */
+    /**************************************************************************/
+    static bool nearest(int32_t ref, int32_t *az) {
+        int32_t d = (*az - ref) % 360000L;
+        if (d > 180000L) {
+            d -= 360000L;
+        } else if (d < -180000L) {
+            d += 360000L;
+        }
+        bool flipped = d > 90000L || d < -90000L;
+        if (flipped) {
+            d += d > 0 ? -180000L : 180000L;
+        }
+        *az = ref + d;
+        return flipped;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Project the direction of the pass and its motion on the
+                  horizon, x to the east and y to the north. The vertical
+                  plane of the motion holds the pass near the zenith
+    */
+    /**************************************************************************/
+    static void project(int32_t az, int32_t el, float v_az, float v_el,
+                        float *x, float *y, float *dx, float *dy) {
+        float a = az * FLIP_RAD, e = el * FLIP_RAD;
+        float sa = sin(a), ca = cos(a), se = sin(e), ce = cos(e);
+        *x = ce * sa;
+        *y = ce * ca;
+        *dx = (-se * v_el * sa + ce * v_az * ca) * FLIP_RAD;
+        *dy = (-se * v_el * ca - ce * v_az * sa) * FLIP_RAD;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set points of a zenith crossing, the elevation is the angle
+                  of the direction in the vertical plane of the azimuth set
+                  point, el' = atan2(sin el, cos el cos daz)
+        @param    v_ref
+                  Speed of the azimuth set point in mdeg/s
+    */
+    /**************************************************************************/
+    void cross(int32_t *az, int32_t *el, float *v_az, float *v_el,
+               float v_ref) {
+        float d = (*az - _ref) * FLIP_RAD;
+        float e = *el * FLIP_RAD;
+        float s = sin(e), c = cos(e), cd = cos(d);
+        float x = c * cd;
+        float ds = c * *v_el * FLIP_RAD;
+        float dx = (-s * cd * *v_el - c * sin(d) * (*v_az - v_ref)) *
+                   FLIP_RAD;
+        *az = _ref;
+        *el = lround(atan2(s, x) / FLIP_RAD);
+        *v_az = v_ref;
+        *v_el = (x * ds - s * dx) / (x * x + s * s) / FLIP_RAD;
+        _last = _ref;
+    }
+};
+
+flip_planner flip;
+
+#endif /* FLIP_H_ */
@@ -10,7 +10,9 @@
 #ifndef LIBRARIES_GLOBALS_H_
 #define LIBRARIES_GLOBALS_H_
 
-#include <Arduino.h>
+#include "hal.h"
+#include "stepper.h"
+#include "units.h"
 
 /** Rotator status */
 enum _rotator_status {
@@ -23,18 +25,22 @@ enum _rotator_error {
 };
 /** Rotator Control Modes */
 enum _control_mode {
-    position = 0, speed = 1
+    position = 0, speed = 1, tracking = 2, prediction = 3, playback = 4
+};
+/** Motion profiles of the step generator */
+enum _motion_profile {
+    trapezoidal = 0, s_curve = 1
 };
 
 struct _control{
-    double input;          ///< Motor Position feedback in deg
-    double input_prv;      ///< T-1 Motor Position feedback in deg
-    double speed;          ///< Motor Rotation speed in deg/s
-    double setpoint;       ///< Position set point in deg
-    double setpoint_speed; ///< Speed set point in deg/s
-    uint16_t load;         ///< Motor Load in mA
-    double u;              ///< Control signal range 0-255
-    double p, i, d;        ///< Control gains
+    int32_t input;          ///< Motor Position feedback in mdeg
+    int32_t input_prv;      ///< T-1 Motor Position feedback in mdeg
+    int32_t speed;          ///< Motor Rotation speed in mdeg/s
+    int32_t setpoint;       ///< Position set point in mdeg
+    int32_t setpoint_speed; ///< Speed set point in mdeg/s
+    uint16_t load;          ///< Motor Load in mA
+    double u;               ///< Control signal range 0-255
+    double p, i, d;         ///< Control gains
 };
 
 struct _rotator{
@@ -43,9 +49,14 @@ struct _rotator{
     enum _control_mode control_mode;              ///< Control mode
     bool homing_flag;                             ///< Homing flag
     int8_t inside_temperature;                    ///< Inside Temperature
-    double park_az, park_el;                      ///< Park position for both axis
+    int32_t park_az, park_el;                     ///< Park position for both axis in mdeg
     uint8_t fault_az, fault_el;                   ///< Motor drivers fault flag
     bool switch_az, switch_el;                    ///< End-stop vales
+    bool coordinated;                             ///< Both axis arrive together
+    enum _motion_profile profile;                 ///< Motion profile
+    uint32_t jerk;                                ///< Jerk limit of S-curve in steps/s^3
+    bool autonomous;                              ///< Run the stored passes
+    bool flip;                                    ///< Cross the zenith in the flipped geometry
 };
 
 _control control_az = { .input = 0, .input_prv = 0, .speed=0, .setpoint = 0,
@@ -58,6 +69,42 @@ _rotator rotator = { .rotator_status = idle, .rotator_error = no_error,
                      .control_mode = position, .homing_flag = false,
                      .inside_temperature = 0, .park_az = 0, .park_el = 0,
                      .fault_az = LOW, .fault_el = LOW , .switch_az = false,
-                     .switch_el = false};
+                     .switch_el = false, .coordinated = false,
+                     .profile = trapezoidal, .jerk = 0,
+                     .autonomous = false, .flip = false };
+
+/**************************************************************************/
+/*!
+    @brief    Set the position set points where both axis stop when they
+              brake now, so a moving axis does not turn back
+*/
+/**************************************************************************/
+void hold_position() {
+    control_az.setpoint = step2mdeg(stepper_az.stopping_point());
+    control_el.setpoint = step2mdeg(stepper_el.stopping_point());
+}
+
+/**************************************************************************/
+/*!
+    @brief    Set the speed of an axis in the velocity mode. From another
+              mode the other axis holds still, and an axis at 0 brakes and
+              holds where it stops
+    @param    control
+              control_az or control_el
+    @param    value
+              Speed in mdeg/s, negative to decrease the angle
+*/
+/**************************************************************************/
+void set_velocity(_control &control, int32_t value) {
+    if (rotator.control_mode != speed) {
+        control_az.setpoint_speed = 0;
+        control_el.setpoint_speed = 0;
+        rotator.control_mode = speed;
+        hold_position();
+    } else if (value == 0) {
+        hold_position();
+    }
+    control.setpoint_speed = value;
+}
 
 #endif /* LIBRARIES_GLOBALS_H_ */
@@ -0,0 +1,329 @@
+/*!
+* @file hal.h
+*
+* It is the hardware abstraction of the firmware. The headers include it
+* instead of the Arduino core and avr-libc, and touch the registers of the
+* USART0, the Timer1 and the TWI only through it. The host build,
+* HOST_BUILD, takes the simulation of the host directory instead.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#define HAL_TIMER_CLOCK (F_CPU / 8) ///< Count rate of the Timer1 in Hz
+#define HAL_UART_UBRR(baudrate) ((F_CPU / 4 / (baudrate) - 1) / 2) ///< Divider of the USART0 at double speed, UBRR0, up to F_CPU / 8
+#define HAL_UART_RATE(baudrate) (F_CPU / 8 / (HAL_UART_UBRR(baudrate) + 1)) ///< Real baudrate of the USART0, the divider rounds it
+
+#ifdef HOST_BUILD
+
+#include "host/hal_host.h"
+
+#else
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+#include <util/atomic.h>
+#include <util/twi.h>
+
+#define HAL_NOINIT __attribute__((section(".noinit"))) ///< RAM that the start-up does not initialize, a reset keeps it
+
+/**************************************************************************/
+/*!
+    @brief    Initialize the USART0, 8N1, with the receive interrupt
+    @param    baudrate
+              Set the baudrate
+*/
+/**************************************************************************/
+inline void hal_uart_init(uint32_t baudrate) {
+    uint16_t ubrr = HAL_UART_UBRR(baudrate);
+    cli();
+    UCSR0A = _BV(U2X0);
+    UBRR0H = ubrr >> 8;
+    UBRR0L = ubrr;
+    UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+    sei();
+}
+
+/**************************************************************************/
+/*!
+    @brief    Read the received byte, from the receive interrupt
+    @return   The byte
+*/
+/**************************************************************************/
+inline uint8_t hal_uart_get() {
+    return UDR0;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Send a byte, from the data register empty interrupt
+    @param    c
+              The byte
+*/
+/**************************************************************************/
+inline void hal_uart_put(uint8_t c) {
+    // Clear the transmit complete flag, it is set again after this byte,
+    // keep the speed and mode bits and write the error flags as 0
+    UCSR0A = (UCSR0A & (_BV(U2X0) | _BV(MPCM0))) | _BV(TXC0);
+    UDR0 = c;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Check if the last sent byte left the shift register, e.g.
+              before the baudrate changes
+    @return   True if the transmitter is done
+*/
+/**************************************************************************/
+inline bool hal_uart_sent() {
+    return UCSR0A & _BV(TXC0);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Enable or disable the data register empty interrupt, it asks
+              for the bytes to send
+    @param    on
+              True to enable
+*/
+/**************************************************************************/
+inline void hal_uart_tx(bool on) {
+    if (on) {
+        UCSR0B |= _BV(UDRIE0);
+    } else {
+        UCSR0B &= ~_BV(UDRIE0);
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief    Enable the transmit complete interrupt, it tells when the last
+              byte left the shift register, e.g. to release a RS485 bus
+*/
+/**************************************************************************/
+inline void hal_uart_txc() {
+    UCSR0B |= _BV(TXCIE0);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Start the Timer1 in CTC mode, TIMER1_COMPA_vect interrupts at
+              a fixed frequency
+    @param    freq
+              Frequency in Hz
+*/
+/**************************************************************************/
+inline void hal_timer_init(uint32_t freq) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TCCR1A = 0;
+        TCCR1B = _BV(WGM12) | _BV(CS11);
+        OCR1A = HAL_TIMER_CLOCK / freq - 1;
+        TCNT1 = 0;
+        TIMSK1 |= _BV(OCIE1A);
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief    Read the count of the Timer1 since the last compare match
+    @return   Counts at HAL_TIMER_CLOCK
+*/
+/**************************************************************************/
+inline uint16_t hal_timer_count() {
+    return TCNT1;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Check if the compare match interrupt of the Timer1 waits, e.g.
+              with the interrupts off
+    @return   True if it waits
+*/
+/**************************************************************************/
+inline bool hal_timer_pending() {
+    return TIFR1 & _BV(OCF1A);
+}
+
+uint8_t hal_reset_flags HAL_NOINIT; ///< MCUSR of the last reset, the start-up clears the register
+
+/**************************************************************************/
+/*!
+    @brief    Stop the watchdog at the start-up, before the RAM is
+              initialized. It stays on after a watchdog reset, at the
+              shortest timeout. MCUSR must be cleared to stop it, so its
+              flags are kept in hal_reset_flags
+*/
+/**************************************************************************/
+void hal_watchdog_boot() __attribute__((naked, used, section(".init3")));
+void hal_watchdog_boot() {
+    hal_reset_flags = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+}
+
+/**************************************************************************/
+/*!
+    @brief    Check the cause of the last reset
+    @return   True if it was the watchdog, false after the power-on, the
+              reset pin or a brown-out
+*/
+/**************************************************************************/
+inline bool hal_watchdog_reset() {
+    return hal_reset_flags & _BV(WDRF);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Start the watchdog, the WDT_vect interrupt at the first timeout
+              and the reset at the next one
+    @param    timeout
+              WDTO_* of avr/wdt.h
+*/
+/**************************************************************************/
+inline void hal_watchdog_start(uint8_t timeout) {
+    wdt_enable(timeout);
+    // The interrupt enable needs no timed sequence
+    WDTCSR |= _BV(WDIE);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Restart the timeout of the watchdog
+*/
+/**************************************************************************/
+inline void hal_watchdog_feed() {
+    wdt_reset();
+}
+
+/**************************************************************************/
+/*!
+    @brief    Reset the board at once, e.g. from the WDT_vect interrupt
+*/
+/**************************************************************************/
+inline void hal_watchdog_restart() {
+    wdt_enable(WDTO_15MS);
+    for (;;) {
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief    Initialize the TWI as I2C master, the TWI_vect interrupt
+              follows every command that hal_twi_* starts, but the stop
+    @param    freq
+              Clock of the bus in Hz
+*/
+/**************************************************************************/
+inline void hal_twi_init(uint32_t freq) {
+    TWSR = 0;
+    TWBR = (F_CPU / freq - 16) / 2;
+    TWCR = _BV(TWEN);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Send a start, or a repeated start in a transfer
+*/
+/**************************************************************************/
+inline void hal_twi_start() {
+    TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Send a stop, without an interrupt
+*/
+/**************************************************************************/
+inline void hal_twi_stop() {
+    TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Send a stop and then a start, for the next transfer
+*/
+/**************************************************************************/
+inline void hal_twi_stop_start() {
+    TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Send a byte, the address and direction or data
+    @param    c
+              The byte
+*/
+/**************************************************************************/
+inline void hal_twi_send(uint8_t c) {
+    TWDR = c;
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Receive a byte
+    @param    ack
+              True to acknowledge it, false for the last byte
+*/
+/**************************************************************************/
+inline void hal_twi_receive(bool ack) {
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | (ack ? _BV(TWEA) : 0);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Get the status of the last command, from the interrupt
+    @return   Status code of the TWI, TW_* of util/twi.h
+*/
+/**************************************************************************/
+inline uint8_t hal_twi_status() {
+    return TWSR & 0xF8;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Get the received byte, from the interrupt
+    @return   The byte
+*/
+/**************************************************************************/
+inline uint8_t hal_twi_data() {
+    return TWDR;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Free a hung bus. The TWI lets go of the pins, then nine clock
+              pulses let a slave finish the byte that holds SDA low, and a
+              stop ends its transfer
+*/
+/**************************************************************************/
+inline void hal_twi_recover() {
+    TWCR = 0;
+    pinMode(SDA, INPUT_PULLUP);
+    for (uint8_t i = 0; i < 9 && digitalRead(SDA) == LOW; i++) {
+        digitalWrite(SCL, LOW);
+        pinMode(SCL, OUTPUT);
+        delayMicroseconds(5);
+        pinMode(SCL, INPUT_PULLUP);
+        delayMicroseconds(5);
+    }
+    // Start and stop, SDA goes low and high while SCL is high
+    digitalWrite(SDA, LOW);
+    pinMode(SDA, OUTPUT);
+    delayMicroseconds(5);
+    pinMode(SDA, INPUT_PULLUP);
+    delayMicroseconds(5);
+    TWCR = _BV(TWEN);
+}
+
+#endif /* HOST_BUILD */
+
+#endif /* HAL_H_ */
@@ -0,0 +1,231 @@
+/*!
+* @file homing.h
+*
+* It is the homing of an axis to its end-stop, with a fast seek, a back-off
+* and a slow approach. The step interrupt latches the step count at the
+* edge of the end-stop, so the home position does not depend on where the
+* axis stops after it.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef HOMING_H_
+#define HOMING_H_
+
+#include "endstop.h"
+#include "stepper.h"
+#include "units.h"
+
+#define HOME_SLOW_SPEED 200   ///< Speed of the slow approach in steps/s, consider the microstep
+#define HOME_BACKOFF    2000L ///< Back-off from the edge of the end-stop before the slow approach in mdeg
+
+/** Phase of the homing of an axis */
+enum _home_phase {
+    home_idle = 0, home_seek = 1, home_brake = 2, home_release = 3,
+    home_back_off = 4, home_approach = 5, home_settle = 6, home_done = 7,
+    home_failed = 8
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the homing of one axis. The axis
+              seeks the end-stop at the maximum speed, brakes, moves off it by
+              HOME_BACKOFF after the edge and approaches it again at
+              HOME_SLOW_SPEED. The edge of the slow approach is the home
+              position, the step count is moved so the latched count is the
+              home angle, and the axis settles there. Both axis home at the
+              same time, run() does not wait
+    @param    axis
+              The stepper of the axis
+    @param    end_stop
+              The end-stop at the home angle
+*/
+/**************************************************************************/
+class home_axis {
+public:
+    home_axis(stepper &axis, endstop &end_stop) : _axis(axis),
+        _end_stop(end_stop) {
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Start the homing, the fast seek, or the back-off if the
+                  end-stop is triggered
+        @param    home
+                  Angle of the end-stop in mdeg
+        @param    seek
+                  Steps to find the end-stop, the sign is the direction
+        @param    max_speed
+                  Speed of the seek in steps/s, it is restored at the end
+    */
+    /**************************************************************************/
+    void start(int32_t home, int32_t seek, uint16_t max_speed) {
+        _home = mdeg2step(home);
+        _seek = seek;
+        _max_speed = max_speed;
+        // The full profile, without the limits of the velocity mode or of
+        // a coordinated move
+        _axis.set_speed_limit(0);
+        _axis.set_ratio(RATIO_ONE);
+        _axis.set_max_speed(max_speed);
+        if (_end_stop.get_state()) {
+            release();
+            return;
+        }
+        _axis.arm_latch(_end_stop.pin(), _end_stop.level());
+        _axis.move_to(_axis.position() + seek);
+        _phase = home_seek;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Run the next phase when the axis reaches it, called from
+                  the loop
+        @return   False if the homing failed, the end-stop was not found or
+                  is not released
+    */
+    /**************************************************************************/
+    bool run() {
+        int32_t edge;
+        switch (_phase) {
+        case home_seek:
+            if (_axis.latched(&edge)) {
+                // Brake with the profile, a loaded worm gear does not stop
+                // at once, the slow approach sets the home position
+                _axis.move_to(_axis.stopping_point());
+                _phase = home_brake;
+            } else if (!_axis.is_running()) {
+                fail();
+            }
+            break;
+        case home_brake:
+            if (!_axis.is_running()) {
+                // Move off the end-stop from the overshoot
+                release();
+            }
+            break;
+        case home_release:
+            if (_axis.latched(&_edge)) {
+                _axis.move_to(_edge + away(mdeg2step(HOME_BACKOFF)));
+                _phase = home_back_off;
+            } else if (!_axis.is_running()) {
+                fail();
+            }
+            break;
+        case home_back_off:
+            if (_axis.is_running()) {
+                break;
+            }
+            if (_end_stop.get_state()) {
+                fail();
+                break;
+            }
+            _axis.set_max_speed(HOME_SLOW_SPEED);
+            _axis.arm_latch(_end_stop.pin(), _end_stop.level());
+            _axis.move_to(_edge - away(mdeg2step(HOME_BACKOFF)));
+            _phase = home_approach;
+            break;
+        case home_approach:
+            if (_axis.latched(&edge)) {
+                // The edge is the home angle, settle there
+                ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                    _axis.correct(_home - edge);
+                    _axis.move_to(_home);
+                }
+                _phase = home_settle;
+            } else if (!_axis.is_running()) {
+                fail();
+            }
+            break;
+        case home_settle:
+            if (!_axis.is_running()) {
+                _axis.set_max_speed(_max_speed);
+                _phase = home_done;
+            }
+            break;
+        default:
+            break;
+        }
+        return _phase != home_failed;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check the end-stop against a known position, e.g. from the
+                  journal. The end-stop is at the minimum angle, the homing
+                  leaves the axis on its edge, so it is triggered at the home
+                  angle and below. A released end-stop at the home angle
+                  fails, e.g. the axis was turned by hand, the homing is the
+                  safe side
+        @param    home
+                  Angle of the end-stop in mdeg
+        @param    angle
+                  Position in mdeg
+        @return   True if the end-stop agrees, a triggered one within
+                  HOME_BACKOFF for its hysteresis
+    */
+    /**************************************************************************/
+    bool check(int32_t home, int32_t angle) {
+        int32_t from_home = angle - home;
+        if (_end_stop.get_state()) {
+            return from_home <= HOME_BACKOFF;
+        }
+        return from_home > 0;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if the axis is homed
+        @return   True if it stands at the home angle
+    */
+    /**************************************************************************/
+    bool done() {
+        return _phase == home_done;
+    }
+
+private:
+    stepper &_axis;
+    endstop &_end_stop;
+    int32_t _home = 0;     ///< Home position in steps
+    int32_t _seek = 0;     ///< Seek distance in steps
+    int32_t _edge = 0;     ///< Position of the release of the end-stop in steps
+    uint16_t _max_speed = 0;
+    uint8_t _phase = home_idle;
+
+    /**************************************************************************/
+    /*!
+        @brief    Move off the end-stop until it is released
+    */
+    /**************************************************************************/
+    void release() {
+        _axis.arm_latch(_end_stop.pin(), !_end_stop.level());
+        _axis.move_to(_axis.position() - _seek);
+        _phase = home_release;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Stop the axis at the failure
+    */
+    /**************************************************************************/
+    void fail() {
+        _axis.disarm_latch();
+        _axis.set_max_speed(_max_speed);
+        _phase = home_failed;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Turn a distance away from the end-stop
+        @param    distance
+                  Distance in steps
+        @return   Distance with the sign away from the end-stop
+    */
+    /**************************************************************************/
+    int32_t away(int32_t distance) {
+        return _seek < 0 ? distance : -distance;
+    }
+};
+
+#endif /* HOMING_H_ */
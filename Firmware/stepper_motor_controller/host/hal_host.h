@@ -0,0 +1,368 @@
+/*!
+* @file hal_host.h
+*
+* It is the host side of the hardware abstraction, for the native build of
+* the firmware on Linux. It stands in for the Arduino calls, the pins, the
+* clock, the USART0, the TWI, the EEPROM and the interrupts that the
+* firmware uses.
+* The clock is virtual, each call of the firmware to the hardware takes
+* HOST_CALL_NS and runs the interrupts that are due, so busy loops like the
+* homing make progress and every run is deterministic.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <math.h>
+
+#define F_CPU 16000000UL ///< Clock of the ATmega328P
+
+#define HOST_CALL_NS 1000 ///< Virtual time of a call to the hardware in ns
+#define HOST_PINS    20   ///< Digital pins, D0-D13 and A0-A5
+#define HOST_EEPROM  1024 ///< Bytes of the EEPROM
+#define HOST_EEPROM_NS 3400000 ///< Time of the write of an EEPROM byte in ns
+
+#define HIGH         1
+#define LOW          0
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+static const uint8_t A0 = 14;
+static const uint8_t A1 = 15;
+static const uint8_t A2 = 16;
+static const uint8_t A3 = 17;
+static const uint8_t A4 = 18;
+static const uint8_t A5 = 19;
+
+typedef uint8_t byte;
+
+#define _BV(bit) (1 << (bit))
+#define constrain(amt, low, high) \
+    ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+/* Ports of the pins as on the ATmega328P, D0-D7 PORTD, D8-D13 PORTB and
+ * A0-A5 PORTC */
+#define digitalPinToPort(p) ((p) < 8 ? 0 : (p) < 14 ? 1 : 2)
+#define digitalPinToBitMask(p) \
+    ((uint8_t)_BV((p) < 8 ? (p) : (p) < 14 ? (p) - 8 : (p) - 14))
+#define portOutputRegister(p) (&host.port[p])
+#define portInputRegister(p) (&host.pin[p])
+
+/* The flash is plain memory */
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_ptr(p)  (*(void * const *)(p))
+
+#define WDTO_15MS 0
+#define WDTO_2S   7
+
+/* The RAM that a reset keeps, main.cpp saves it with the EEPROM */
+#define HAL_NOINIT __attribute__((section("host_noinit")))
+
+/* The interrupt vectors are functions, the simulation calls them */
+#define ISR(vector) void vector()
+void TIMER1_COMPA_vect();
+void USART_RX_vect();
+void USART_UDRE_vect();
+void USART_TX_vect();
+void TWI_vect();
+void WDT_vect();
+
+/* Status codes of the TWI, as util/twi.h */
+#define TW_START        0x08
+#define TW_REP_START    0x10
+#define TW_MT_SLA_ACK   0x18
+#define TW_MT_SLA_NACK  0x20
+#define TW_MT_DATA_ACK  0x28
+#define TW_MT_DATA_NACK 0x30
+#define TW_MT_ARB_LOST  0x38
+#define TW_MR_SLA_ACK   0x40
+#define TW_MR_SLA_NACK  0x48
+#define TW_MR_DATA_ACK  0x50
+#define TW_MR_DATA_NACK 0x58
+#define TW_BUS_ERROR    0x00
+#define TW_READ         1
+#define TW_WRITE        0
+
+/** State of the simulated hardware */
+struct host_hal {
+    uint64_t ns;                   ///< Virtual time in ns
+    bool interrupts;               ///< Global interrupt enable, the I bit
+    bool in_isr;                   ///< An interrupt routine runs
+    volatile uint8_t port[3];      ///< Output registers of the ports
+    uint8_t mode[HOST_PINS];       ///< Pin modes
+    volatile uint8_t pin[3];       ///< Input registers of the ports
+    uint64_t timer_period;         ///< Timer1 period in ns, 0 if stopped
+    uint64_t timer_next;           ///< Next Timer1 interrupt in ns
+    uint32_t baudrate;             ///< USART0 baudrate, 0 if stopped
+    uint8_t udr;                   ///< Received byte
+    bool udre;                     ///< Data register empty interrupt enable
+    bool txcie;                    ///< Transmit complete interrupt enable
+    bool tx_busy;                  ///< A byte is in the shift register until tx_next
+    uint64_t rx_next, tx_next;     ///< Next free time of RX and TX in ns
+    uint32_t twi_freq;             ///< I2C clock in Hz, 0 if stopped
+    bool twi_pending;              ///< A TWI interrupt is due at twi_next
+    uint64_t twi_next;             ///< Time of the TWI interrupt in ns
+    uint8_t twi_status, twi_data;  ///< TWSR and TWDR
+    uint8_t eeprom[HOST_EEPROM];   ///< EEPROM content
+    uint64_t eeprom_next;          ///< End of the EEPROM write in ns
+    uint64_t wdt_period;           ///< Watchdog timeout in ns, 0 if stopped
+    uint64_t wdt_next;             ///< Next timeout of the watchdog in ns
+    bool wdie;                     ///< Watchdog interrupt enable, the next timeout resets
+    bool wdrf;                     ///< The run follows a watchdog reset, -E kept the RAM
+};
+
+extern host_hal host;
+
+/**************************************************************************/
+/*!
+    @brief    Take the time of a call to the hardware and run the interrupts
+              that are due, it is in main.cpp
+*/
+/**************************************************************************/
+void host_poll();
+
+/**************************************************************************/
+/*!
+    @brief    Reset of the board by the watchdog, it is in main.cpp
+*/
+/**************************************************************************/
+void host_reset();
+
+/**************************************************************************/
+/*!
+    @brief    Send a byte of the USART0 to the host, it is in main.cpp
+*/
+/**************************************************************************/
+void host_uart_out(uint8_t c);
+
+/** Commands of the simulated TWI */
+enum host_twi_command {
+    host_twi_start, host_twi_stop, host_twi_stop_start, host_twi_send,
+    host_twi_ack, host_twi_nack, host_twi_recover
+};
+
+/**************************************************************************/
+/*!
+    @brief    Run a command of the TWI on the simulated I2C bus, it is in
+              main.cpp
+    @param    command
+              host_twi_command
+    @param    data
+              Byte to send
+*/
+/**************************************************************************/
+void host_twi(uint8_t command, uint8_t data);
+
+inline unsigned long millis() {
+    host_poll();
+    return host.ns / 1000000;
+}
+
+inline unsigned long micros() {
+    host_poll();
+    return host.ns / 1000;
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+    host.mode[pin] = mode;
+}
+
+inline int digitalRead(uint8_t pin) {
+    host_poll();
+    return (host.pin[digitalPinToPort(pin)] & digitalPinToBitMask(pin)) != 0;
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+    volatile uint8_t *reg = portOutputRegister(digitalPinToPort(pin));
+    if (value) {
+        *reg |= digitalPinToBitMask(pin);
+    } else {
+        *reg &= ~digitalPinToBitMask(pin);
+    }
+}
+
+inline void cli() {
+    host.interrupts = false;
+}
+
+inline void sei() {
+    host.interrupts = true;
+}
+
+/** Interrupts are off, or on, in the block and restored after it */
+struct host_atomic {
+    bool sreg, done;
+    explicit host_atomic(bool on) : sreg(host.interrupts), done(false) {
+        host.interrupts = on;
+    }
+    ~host_atomic() {
+        host.interrupts = sreg;
+    }
+};
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) \
+    for (host_atomic _atomic(false); !_atomic.done; _atomic.done = true)
+
+// The interrupts do not nest on the host, an interrupt routine runs whole
+#define NONATOMIC_FORCEOFF 0
+#define NONATOMIC_BLOCK(type) \
+    for (host_atomic _nonatomic(true); !_nonatomic.done; _nonatomic.done = true)
+
+inline bool eeprom_is_ready() {
+    host_poll();
+    return host.ns >= host.eeprom_next;
+}
+
+/** The access waits for the write of the last byte, as avr-libc */
+inline void eeprom_busy_wait() {
+    while (!eeprom_is_ready()) {
+    }
+}
+
+inline uint8_t eeprom_read_byte(const uint8_t *addr) {
+    eeprom_busy_wait();
+    return host.eeprom[(uintptr_t)addr % HOST_EEPROM];
+}
+
+inline void eeprom_update_byte(uint8_t *addr, uint8_t value) {
+    uint8_t *cell = &host.eeprom[(uintptr_t)addr % HOST_EEPROM];
+    eeprom_busy_wait();
+    if (*cell != value) {
+        *cell = value;
+        host.eeprom_next = host.ns + HOST_EEPROM_NS;
+    }
+}
+
+inline void eeprom_read_block(void *dst, const void *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        ((uint8_t *)dst)[i] = eeprom_read_byte((const uint8_t *)src + i);
+    }
+}
+
+inline void eeprom_update_block(const void *src, void *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        eeprom_update_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+    }
+}
+
+inline void wdt_enable(uint8_t timeout) {
+    (void)timeout;
+    host_reset();
+}
+
+inline void wdt_reset() {
+}
+
+inline void hal_watchdog_start(uint8_t timeout) {
+    host.wdt_period = 16000000ULL << timeout;
+    host.wdt_next = host.ns + host.wdt_period;
+    host.wdie = true;
+}
+
+inline void hal_watchdog_feed() {
+    host.wdt_next = host.ns + host.wdt_period;
+}
+
+inline void hal_watchdog_restart() {
+    host_reset();
+}
+
+inline bool hal_watchdog_reset() {
+    return host.wdrf;
+}
+
+inline void hal_uart_init(uint32_t baudrate) {
+    host.baudrate = baudrate;
+    host.txcie = false;
+}
+
+inline uint8_t hal_uart_get() {
+    return host.udr;
+}
+
+inline void hal_uart_put(uint8_t c) {
+    host.tx_busy = true;
+    host_uart_out(c);
+}
+
+inline void hal_uart_tx(bool on) {
+    host.udre = on;
+}
+
+inline void hal_uart_txc() {
+    host.txcie = true;
+}
+
+inline bool hal_uart_sent() {
+    host_poll();
+    return !host.udre && host.tx_next <= host.ns;
+}
+
+inline void hal_timer_init(uint32_t freq) {
+    host.timer_period = 1000000000ULL / freq;
+    host.timer_next = host.ns + host.timer_period;
+}
+
+inline uint16_t hal_timer_count() {
+    if (host.timer_period == 0) {
+        return 0;
+    }
+    uint64_t ns = (host.ns + host.timer_period - host.timer_next) %
+                  host.timer_period;
+    return ns * HAL_TIMER_CLOCK / 1000000000ULL;
+}
+
+inline bool hal_timer_pending() {
+    return host.timer_next <= host.ns;
+}
+
+inline void hal_twi_init(uint32_t freq) {
+    host.twi_freq = freq;
+}
+
+inline void hal_twi_start() {
+    host_twi(host_twi_start, 0);
+}
+
+inline void hal_twi_stop() {
+    host_twi(host_twi_stop, 0);
+}
+
+inline void hal_twi_stop_start() {
+    host_twi(host_twi_stop_start, 0);
+}
+
+inline void hal_twi_send(uint8_t c) {
+    host_twi(host_twi_send, c);
+}
+
+inline void hal_twi_receive(bool ack) {
+    host_twi(ack ? host_twi_ack : host_twi_nack, 0);
+}
+
+inline uint8_t hal_twi_status() {
+    return host.twi_status;
+}
+
+inline uint8_t hal_twi_data() {
+    return host.twi_data;
+}
+
+inline void hal_twi_recover() {
+    host_twi(host_twi_recover, 0);
+}
+
+#endif /* HAL_HOST_H_ */
@@ -0,0 +1,583 @@
+/*!
+* @file main.cpp
+*
+* It is the native Linux build of the firmware. It runs the setup() and
+* loop() of the sketch against the simulated hardware of hal_host.h, with
+* a rotator that moves with the step pulses, works the end-stops and has an
+* AS5601 encoder on each axis behind a PCA9540 multiplexer and a TC74 on
+* the I2C bus. The USART0 is bridged to stdin and stdout.
+*
+* Usage: rotator_host [-r] [-t seconds] [-l loop_us] [-a deg] [-e deg]
+*                     [-m n] [-b seconds] [-k deg] [-E file] [-v]
+*
+* -r runs in real time, for a client on a pseudo terminal, else the virtual
+*    clock runs as fast as it can and stdin is a script. A script line
+*    "@<ms>" waits until that virtual time before the next line
+* -t stops after that virtual time, by default 1 s after the end of a
+*    script, never in real time
+* -l virtual time of a loop() in us, 500 by default
+* -a, -e start position of each axis from its end-stop, 10 deg by default
+* -m the azimuth misses one of n step pulses, as a motor that loses steps
+* -b a slave hangs the I2C bus at that virtual time in s, until the
+*    firmware recovers it
+* -k backlash of the gear of both axis in deg, the motor turns that much
+*    after a reversal before the axis follows
+* -E keeps the EEPROM in a file, it is read at the start and written at
+*    the end, so a run restarts from the state of the previous one. After
+*    a watchdog reset the file keeps the RAM of HAL_NOINIT too, as the
+*    board does, the end of a run is a power-off
+* -v prints the position of both axis every second to stderr
+*
+* With ENABLE_RS485 it counts the bytes sent while the direction pin does
+* not drive the bus, they would be lost on a RS485 bus, and the USART0
+* receives its own bytes, as a transceiver with the receiver always on
+*
+* Licensed under the GPLv3
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include "../satnogs_rotator_controller_modified_SuperAntennaz.ino"
+#include "../sensors.h"
+
+#define HOST_LINE 256 ///< Longest script line
+
+#if ENABLE_ENCODER
+#define HOST_ENC_RATIO ENC_RATIO
+#else
+#define HOST_ENC_RATIO 2 ///< Turns of the simulated encoders per turn of the axis
+#endif
+#define HOST_TEMPERATURE 25 ///< Reading of the TC74 in deg C
+
+host_hal host;
+
+/* The RAM of HAL_NOINIT, the linker marks the section */
+extern uint8_t __start_host_noinit[] __attribute__((weak));
+extern uint8_t __stop_host_noinit[] __attribute__((weak));
+
+/** Axis of the simulated rotator, moved by the step pulses */
+struct host_axis {
+    uint8_t step_pin, dir_pin, switch_pin;
+    int32_t position; ///< Steps of the axis from the end-stop
+    int32_t motor;    ///< Steps of the motor, position to position + slack
+    int32_t slack;    ///< Backlash of the gear in steps
+    bool step_level;
+    uint32_t miss;    ///< Misses one of miss step pulses, 0 for none
+    uint32_t pulses;
+
+    bool level(uint8_t pin) {
+        return host.port[digitalPinToPort(pin)] & digitalPinToBitMask(pin);
+    }
+
+    /** Count a step on the rising edge, if the driver is enabled, and set
+     *  the end-stop input. The axis follows the motor beyond the backlash */
+    void update() {
+        bool step = level(step_pin);
+        if (step && !step_level && !level(MOTOR_EN) &&
+            (miss == 0 || ++pulses % miss != 0)) {
+            motor += level(dir_pin) ? 1 : -1;
+            if (motor > position + slack) {
+                position = motor - slack;
+            } else if (motor < position) {
+                position = motor;
+            }
+        }
+        step_level = step;
+        bool active = position <= 0;
+        volatile uint8_t *reg = portInputRegister(digitalPinToPort(switch_pin));
+        if (active == (DEFAULT_HOME_STATE == HIGH)) {
+            *reg |= digitalPinToBitMask(switch_pin);
+        } else {
+            *reg &= ~digitalPinToBitMask(switch_pin);
+        }
+    }
+};
+
+static host_axis axis_az = { M1IN1, M1IN2, SW1, 0, 0, 0, false, 0, 0 };
+static host_axis axis_el = { M2IN1, M2IN2, SW2, 0, 0, 0, false, 0, 0 };
+
+/* I2C bus, the PCA9540 selects the encoder of an axis */
+static struct {
+    bool active, addressed, hung;
+    uint8_t addr, reg, bytes;
+} bus;
+static uint8_t mux_control = 0;
+static uint64_t hang_at = 0; ///< Time when a slave hangs the bus, 0 if never
+#if ENABLE_RS485
+static uint32_t undriven = 0; ///< Bytes sent with the RS485 bus released
+static int echo = -1;         ///< Byte on the bus, the receiver hears it at its end
+#endif
+
+/* Input of the USART0 */
+static char rx_line[HOST_LINE];
+static size_t rx_len = 0, rx_pos = 0;
+static uint64_t rx_wait = 0;
+static bool rx_eof = false;
+static bool realtime = false;
+static const char *eeprom_file = NULL;
+
+/**************************************************************************/
+/*!
+    @brief    Get the next byte for the USART0 from stdin
+    @return   The byte, or -1 if there is none now
+*/
+/**************************************************************************/
+static int next_input() {
+    while (rx_pos == rx_len) {
+        if (rx_eof || host.ns < rx_wait) {
+            return -1;
+        }
+        if (realtime) {
+            struct pollfd p = { STDIN_FILENO, POLLIN, 0 };
+            if (poll(&p, 1, 0) <= 0) {
+                return -1;
+            }
+            ssize_t n = read(STDIN_FILENO, rx_line, sizeof(rx_line));
+            if (n <= 0) {
+                rx_eof = true;
+                return -1;
+            }
+            rx_len = n;
+            rx_pos = 0;
+            continue;
+        }
+        // A line may hold 0x00, e.g. the frames of the binary protocol
+        rx_len = 0;
+        rx_pos = 0;
+        int c = 0;
+        while (rx_len < sizeof(rx_line) && c != '\n' &&
+               (c = getchar()) != EOF) {
+            rx_line[rx_len++] = c;
+        }
+        if (rx_len == 0) {
+            rx_eof = true;
+            return -1;
+        }
+        if (rx_line[0] == '@') {
+            // Script line, wait until the virtual time in ms
+            rx_wait = strtoull(rx_line + 1, NULL, 10) * 1000000ULL;
+            rx_len = 0;
+        }
+    }
+    return (uint8_t)rx_line[rx_pos++];
+}
+
+/**************************************************************************/
+/*!
+    @brief    Run the interrupts that are due at the virtual time
+*/
+/**************************************************************************/
+static void run_interrupts() {
+    if (!host.interrupts || host.in_isr) {
+        return;
+    }
+    host.in_isr = true;
+    uint64_t byte_ns = host.baudrate ? 10000000000ULL / host.baudrate : 0;
+    while (host.timer_period && host.timer_next <= host.ns) {
+        TIMER1_COMPA_vect();
+        axis_az.update();
+        axis_el.update();
+        host.timer_next += host.timer_period;
+    }
+    if (byte_ns && host.rx_next <= host.ns) {
+        int c = next_input();
+        if (c >= 0) {
+            host.udr = c;
+            USART_RX_vect();
+            host.rx_next = host.ns + byte_ns;
+        }
+    }
+#if ENABLE_RS485
+    if (echo >= 0 && host.tx_next <= host.ns) {
+        host.udr = echo;
+        echo = -1;
+        USART_RX_vect();
+    }
+#endif
+    if (byte_ns && host.udre && host.tx_next <= host.ns) {
+        USART_UDRE_vect();
+        host.tx_next = host.ns + byte_ns;
+    }
+#if ENABLE_RS485
+    if (host.txcie && host.tx_busy && host.tx_next <= host.ns) {
+        // The stop bit of the last byte is out
+        host.tx_busy = false;
+        USART_TX_vect();
+    }
+#endif
+#ifdef TWI_H_
+    if (host.twi_pending && host.twi_next <= host.ns) {
+        host.twi_pending = false;
+        TWI_vect();
+    }
+#endif
+    if (host.wdt_period && host.wdt_next <= host.ns) {
+        if (!host.wdie) {
+            host_reset();
+        }
+        // The interrupt first, the next timeout resets
+        host.wdie = false;
+        host.wdt_next += host.wdt_period;
+        WDT_vect();
+    }
+    host.in_isr = false;
+}
+
+void host_poll() {
+    host.ns += HOST_CALL_NS;
+    run_interrupts();
+}
+
+/**************************************************************************/
+/*!
+    @brief    Read or write the EEPROM file of -E, the RAM of HAL_NOINIT
+              follows the EEPROM after a reset
+    @param    write
+              True to write it
+    @param    ram
+              True to write the RAM too, at a reset
+*/
+/**************************************************************************/
+static void eeprom_image(bool write, bool ram) {
+    if (eeprom_file == NULL) {
+        return;
+    }
+    FILE *f = fopen(eeprom_file, write ? "wb" : "rb");
+    if (f == NULL) {
+        return;
+    }
+    size_t noinit = __stop_host_noinit - __start_host_noinit;
+    if (write) {
+        fwrite(host.eeprom, 1, sizeof(host.eeprom), f);
+        if (ram) {
+            fwrite(__start_host_noinit, 1, noinit, f);
+        }
+    } else if (fread(host.eeprom, 1, sizeof(host.eeprom), f) !=
+               sizeof(host.eeprom)) {
+        memset(host.eeprom, 0xFF, sizeof(host.eeprom));
+    } else if (fread(__start_host_noinit, 1, noinit, f) != noinit) {
+        // A power-off, the RAM is not kept
+        memset(__start_host_noinit, 0, noinit);
+    } else {
+        host.wdrf = true;
+    }
+    fclose(f);
+}
+
+void host_reset() {
+    eeprom_image(true, true);
+    fflush(stdout);
+    fprintf(stderr, "host: watchdog reset at %.3f s\n", host.ns / 1e9);
+    exit(0);
+}
+
+void host_uart_out(uint8_t c) {
+#if ENABLE_RS485
+    if (!(host.port[digitalPinToPort(RS485_DIR)] &
+          digitalPinToBitMask(RS485_DIR))) {
+        undriven++;
+    }
+    echo = c;
+#endif
+    putchar(c);
+    if (c == '\n' || realtime) {
+        fflush(stdout);
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief    Advance the virtual clock, with the interrupts on the way
+    @param    ns
+              Time in ns
+*/
+/**************************************************************************/
+static void advance(uint64_t ns) {
+    uint64_t end = host.ns + ns;
+    while (host.ns < end) {
+        uint64_t next = end;
+        if (host.timer_period && host.timer_next < next) {
+            next = host.timer_next;
+        }
+        if (host.twi_pending && host.twi_next < next) {
+            next = host.twi_next;
+        }
+        host.ns = next > host.ns ? next : host.ns + HOST_CALL_NS;
+        run_interrupts();
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief    Get the encoder of the selected channel of the multiplexer
+    @return   The axis, NULL if no channel is selected
+*/
+/**************************************************************************/
+static host_axis *encoder_axis() {
+    if (mux_control == PCA9540_CH0) {
+        return &axis_az;
+    }
+    return mux_control == PCA9540_CH1 ? &axis_el : NULL;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Check if a device answers to an address
+*/
+/**************************************************************************/
+static bool i2c_present(uint8_t addr) {
+    return addr == PCA9540_ID || addr == TC74_ID ||
+           (addr == AS5601_ID && encoder_axis() != NULL);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Write a byte to the addressed device, the first byte sets the
+              register address
+*/
+/**************************************************************************/
+static void i2c_write(uint8_t c) {
+    if (bus.addr == PCA9540_ID) {
+        mux_control = c;
+    } else if (bus.bytes == 0) {
+        bus.reg = c;
+    }
+    bus.bytes++;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Read a byte from the addressed device, the register address
+              increments
+*/
+/**************************************************************************/
+static uint8_t i2c_read() {
+    uint8_t reg = bus.reg++;
+    if (bus.addr == TC74_ID) {
+        return reg == TC74_TEMPERATURE_REGISTER ? HOST_TEMPERATURE :
+                                                  TC74_DATA_READY_FLAG;
+    }
+    host_axis *axis = encoder_axis();
+    if (bus.addr != AS5601_ID || axis == NULL) {
+        return 0xFF;
+    }
+    // The AS5601 turns against the axis, see get_pos()
+    int64_t counts = -(int64_t)axis->position * HOST_ENC_RATIO *
+                     AS5601_COUNTS / (RATIO * SPR);
+    uint16_t raw = counts & (AS5601_COUNTS - 1);
+    switch (reg) {
+    case STATUS_REG:
+        return AS5601_MD;
+    case RAW_ANG_HIGH:
+        return raw >> 8;
+    case RAW_ANG_LOW:
+        return raw & 0xFF;
+    default:
+        return 0;
+    }
+}
+
+void host_twi(uint8_t command, uint8_t data) {
+    uint8_t bits = 9;
+    if (command == host_twi_recover) {
+        fprintf(stderr, "host: %.3f s, I2C bus recovered\n", host.ns / 1e9);
+        memset(&bus, 0, sizeof(bus));
+        host.twi_pending = false;
+        return;
+    }
+    if (bus.hung || (hang_at && host.ns >= hang_at)) {
+        // A slave holds SDA low, the TWI waits for ever
+        hang_at = 0;
+        bus.hung = true;
+        return;
+    }
+    switch (command) {
+    case host_twi_stop:
+        bus.active = false;
+        return;
+    case host_twi_stop_start:
+        bus.active = false;
+        // fall through
+    case host_twi_start:
+        host.twi_status = bus.active ? TW_REP_START : TW_START;
+        bus.active = true;
+        bus.addressed = false;
+        bits = 2;
+        break;
+    case host_twi_send:
+        if (!bus.addressed) {
+            bool ack = i2c_present(data >> 1);
+            bus.addr = data >> 1;
+            bus.addressed = true;
+            bus.bytes = 0;
+            if (data & TW_READ) {
+                host.twi_status = ack ? TW_MR_SLA_ACK : TW_MR_SLA_NACK;
+            } else {
+                host.twi_status = ack ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+            }
+        } else {
+            i2c_write(data);
+            host.twi_status = TW_MT_DATA_ACK;
+        }
+        break;
+    case host_twi_ack:
+    case host_twi_nack:
+        host.twi_data = i2c_read();
+        host.twi_status = command == host_twi_ack ? TW_MR_DATA_ACK :
+                                                    TW_MR_DATA_NACK;
+        break;
+    }
+    host.twi_pending = true;
+    host.twi_next = host.ns + bits * 1000000000ULL / host.twi_freq;
+}
+
+static double axis_deg(int32_t steps) {
+    return steps * 360.0 / (RATIO * SPR);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Get the difference of the position of the firmware from the
+              position of the simulated axis
+    @param    axis
+              Simulated axis
+    @param    steps
+              Position of the firmware in steps
+    @param    min_angle
+              Angle of the end-stop in deg
+    @return   Difference in deg
+*/
+/**************************************************************************/
+static double axis_error(const host_axis &axis, int32_t steps,
+                         int32_t min_angle) {
+    return axis_deg(steps - mdeg2step(min_angle * 1000L) - axis.position);
+}
+
+int main(int argc, char **argv) {
+    double stop = -1, az = 10, el = 10, backlash = 0;
+    uint64_t loop_ns = 500000;
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "rt:l:a:e:m:b:k:E:v")) != -1) {
+        switch (opt) {
+        case 'r':
+            realtime = true;
+            break;
+        case 't':
+            stop = atof(optarg);
+            break;
+        case 'l':
+            loop_ns = strtoull(optarg, NULL, 10) * 1000;
+            break;
+        case 'a':
+            az = atof(optarg);
+            break;
+        case 'e':
+            el = atof(optarg);
+            break;
+        case 'm':
+            axis_az.miss = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            hang_at = atof(optarg) * 1e9;
+            break;
+        case 'k':
+            backlash = atof(optarg);
+            break;
+        case 'E':
+            eeprom_file = optarg;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r] [-t seconds] [-l loop_us] "
+                    "[-a deg] [-e deg] [-m n] [-b seconds] [-k deg] "
+                    "[-E file] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (realtime) {
+        setvbuf(stdout, NULL, _IONBF, 0);
+    }
+    memset(host.eeprom, 0xFF, sizeof(host.eeprom));
+    eeprom_image(false, false);
+    // The inputs have pull-ups
+    memset((void *)host.pin, 0xFF, sizeof(host.pin));
+    axis_az.position = lround(az * RATIO * SPR / 360);
+    axis_el.position = lround(el * RATIO * SPR / 360);
+    // The last motion before the start was positive, as the firmware takes
+    axis_az.slack = axis_el.slack = lround(backlash * RATIO * SPR / 360);
+    axis_az.motor = axis_az.position + axis_az.slack;
+    axis_el.motor = axis_el.position + axis_el.slack;
+    axis_az.update();
+    axis_el.update();
+    // The Arduino core enables the interrupts before setup()
+    host.interrupts = true;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t end_of_input = 0, report = 1000000000ULL;
+    bool homed = false;
+    setup();
+    for (;;) {
+        loop();
+        if (rotator.homing_flag != homed) {
+            homed = rotator.homing_flag;
+            if (homed) {
+                // Time and repeatability of the homing
+                fprintf(stderr, "host: %.3f s, homed, error az %.3f deg, "
+                        "el %.3f deg\n", host.ns / 1e9,
+                        axis_error(axis_az, stepper_az.position(),
+                                   MIN_M1_ANGLE),
+                        axis_error(axis_el, stepper_el.position(),
+                                   MIN_M2_ANGLE));
+            }
+        }
+        advance(loop_ns);
+        if (verbose && host.ns >= report) {
+            fprintf(stderr, "host: %8.3f s az %8.3f el %8.3f deg\n",
+                    host.ns / 1e9, axis_deg(axis_az.position),
+                    axis_deg(axis_el.position));
+            report = host.ns - host.ns % 1000000000ULL + 1000000000ULL;
+        }
+        if (stop >= 0 && host.ns >= stop * 1e9) {
+            break;
+        }
+        if (!realtime && stop < 0 && rx_eof) {
+            // 1 s after the end of the script
+            if (end_of_input == 0) {
+                end_of_input = host.ns;
+            } else if (host.ns - end_of_input >= 1000000000ULL) {
+                break;
+            }
+        }
+        if (realtime) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t real = (now.tv_sec - start.tv_sec) * 1000000000LL +
+                           (now.tv_nsec - start.tv_nsec);
+            if ((int64_t)host.ns > real) {
+                usleep((host.ns - real) / 1000);
+            }
+        }
+    }
+    eeprom_image(true, false);
+    fflush(stdout);
+    fprintf(stderr, "host: %.3f s, az %.3f deg, el %.3f deg from the "
+            "end-stops\n", host.ns / 1e9, axis_deg(axis_az.position),
+            axis_deg(axis_el.position));
+#if ENABLE_RS485
+    fprintf(stderr, "host: RS485, %u bytes sent on the released bus, the "
+            "bus is %s\n", undriven,
+            host.port[digitalPinToPort(RS485_DIR)] &
+            digitalPinToBitMask(RS485_DIR) ? "held" : "released");
+#endif
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*!
+* @file i2c_mux.h
+*
+* It is a driver for I2C 1-of-2 multiplexer (like PCA9540B) with 2-Channels.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef I2C_MUX_H_
+#define I2C_MUX_H_
+
+#include "twi.h"
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for interacting with  I2C 1-of-2 multiplexer.
+    @param    id
+              I2C ID in HEX
+    @param    ch0
+              Channel 0 in HEX
+    @param    ch1
+              Channel 1 in HEX
+*/
+/**************************************************************************/
+class i2c_mux {
+public:
+
+    i2c_mux(uint8_t id, uint8_t ch0, uint8_t ch1) {
+        _id = id;
+        _ch0 = ch0;
+        _ch1 = ch1;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the I2C bus
+    */
+    /**************************************************************************/
+    void init() {
+        twi.init();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Queue the change of the channel, the transfers queued after
+                  it go to that channel
+        @param    ch
+                  Set the channel that is connected with Master, CH0 or CH1
+        @return   False if the change could not be queued
+    */
+    /**************************************************************************/
+    bool set_channel(uint8_t ch) {
+        if (ch != _ch0 && ch != _ch1) {
+            return false;
+        }
+        twi_transfer &t = _select[ch == _ch1];
+        t.addr = _id;
+        t.tx = ch == _ch1 ? &_ch1 : &_ch0;
+        t.tx_len = 1;
+        return twi.submit(t);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check the last change to a channel
+        @param    ch
+                  The channel, CH0 or CH1
+        @return   True if the multiplexer acknowledged it
+    */
+    /**************************************************************************/
+    bool selected(uint8_t ch) {
+        return _select[ch == _ch1].state == twi_done;
+    }
+
+private:
+    uint8_t _id, _ch0, _ch1;
+    twi_transfer _select[2] = { };
+};
+
+#endif /* I2C_MUX_H_ */
@@ -0,0 +1,206 @@
+/*!
+* @file journal.h
+*
+* It is the journal of the position in EEPROM, after the pass storage. It
+* keeps the last settled position of both axis, so a clean restart resumes
+* from it without the homing.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stddef.h>
+#include "hal.h"
+
+#define JOURNAL_BASE   896   ///< First EEPROM byte of the journal, after the passes
+#define JOURNAL_SIZE   128   ///< EEPROM bytes of the journal, up to the end of the EEPROM
+#define JOURNAL_SETTLE 30000 ///< Time at rest before the position is recorded in ms, a pause of the tracking is shorter
+#define JOURNAL_MOVING 0x80  ///< Mark of the sequence number, the axis moved after the record
+#define JOURNAL_SEQ    0x7F  ///< Bits of the sequence number
+
+/**
+ * Record of the journal, 8 bytes, so 16 of them fill the journal. The
+ * records fill the slots in turn to spread the wear, the one with the
+ * newest sequence number counts. The positions take 24 bits, +-8388 deg.
+ * The check covers the positions and the sequence number without the
+ * mark, which is set alone when the axis start to move. The sequence
+ * number is the last byte written, a record that is torn by a reset fails
+ * the check and the older one, moving, counts.
+ */
+struct __attribute__((packed)) _journal_record {
+    uint8_t az[3]; ///< Azimuth in mdeg, little-endian
+    uint8_t el[3]; ///< Elevation in mdeg, little-endian
+    uint8_t check; ///< CRC-8 of the fields above and of the sequence number
+    uint8_t seq;   ///< Sequence number, with JOURNAL_MOVING
+};
+
+#define JOURNAL_SLOTS (JOURNAL_SIZE / sizeof(_journal_record)) ///< Records in the journal
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the position journal. The position
+              is recorded once both axis rest for JOURNAL_SETTLE, a byte
+              per round of the loop when the EEPROM is ready, and the
+              record is marked as moving, one byte, when they start again.
+              A reset while the axis move, or at an error, leaves a moving
+              record and the next start homes
+*/
+/**************************************************************************/
+class position_journal {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Find the newest record
+        @param    az
+                  The azimuth in mdeg of a settled record
+        @param    el
+                  The elevation in mdeg of a settled record
+        @return   True if the newest record is settled
+    */
+    /**************************************************************************/
+    bool restore(int32_t *az, int32_t *el) {
+        _record r, newest = { };
+        bool found = false;
+        for (uint8_t i = 0; i < JOURNAL_SLOTS; i++) {
+            read(i, &r);
+            if (r.check != crc(r) ||
+                (found && (int8_t)((r.seq - newest.seq) << 1) <= 0)) {
+                continue;
+            }
+            newest = r;
+            _slot = i;
+            found = true;
+        }
+        if (!found) {
+            return false;
+        }
+        _seq = newest.seq & JOURNAL_SEQ;
+        _settled = !(newest.seq & JOURNAL_MOVING);
+        *az = get24(newest.az);
+        *el = get24(newest.el);
+        return _settled;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Follow the axis and write the record, called from the loop
+                  once the position is known
+        @param    moving
+                  True if an axis moves
+        @param    az
+                  The azimuth in mdeg
+        @param    el
+                  The elevation in mdeg
+    */
+    /**************************************************************************/
+    void update(bool moving, int32_t az, int32_t el) {
+        if (moving) {
+            invalidate();
+            _since = millis();
+        } else if (!_settled && _written == sizeof(_record) &&
+                   millis() - _since >= JOURNAL_SETTLE) {
+            write(az, el);
+        }
+        if (_written < sizeof(_record) && eeprom_is_ready()) {
+            eeprom_update_byte(slot_addr(_slot) + _written,
+                               ((const uint8_t *)&_pending)[_written]);
+            if (++_written == sizeof(_record)) {
+                _settled = true;
+            }
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Mark the newest record as moving, the position is not known
+                  after a reset. A record that is not written yet is dropped,
+                  without its sequence number it does not count
+    */
+    /**************************************************************************/
+    void invalidate() {
+        if (_written < sizeof(_record)) {
+            _written = sizeof(_record);
+        } else if (_settled) {
+            eeprom_update_byte(slot_addr(_slot) + offsetof(_record, seq),
+                               _seq | JOURNAL_MOVING);
+            _settled = false;
+        }
+    }
+
+private:
+    typedef _journal_record _record;
+
+    uint8_t _slot = JOURNAL_SLOTS - 1; ///< Slot of the newest record
+    uint8_t _seq = 0;                  ///< Sequence number of the newest record
+    bool _settled = false;             ///< The newest record is settled
+    uint32_t _since = 0;               ///< Time of the last motion
+    _record _pending;                  ///< Record that is written
+    uint8_t _written = sizeof(_record); ///< Bytes of the pending record in EEPROM
+
+    /**************************************************************************/
+    /*!
+        @brief    Start the write of a settled record to the next slot
+        @param    az
+                  The azimuth in mdeg
+        @param    el
+                  The elevation in mdeg
+    */
+    /**************************************************************************/
+    void write(int32_t az, int32_t el) {
+        _slot = (_slot + 1) % JOURNAL_SLOTS;
+        _seq = (_seq + 1) & JOURNAL_SEQ;
+        put24(_pending.az, az);
+        put24(_pending.el, el);
+        _pending.seq = _seq;
+        _pending.check = crc(_pending);
+        _written = 0;
+    }
+
+    void read(uint8_t slot, _record *r) {
+        eeprom_read_block(r, slot_addr(slot), sizeof(*r));
+    }
+
+    static uint8_t *slot_addr(uint8_t slot) {
+        return (uint8_t *)(JOURNAL_BASE + slot * sizeof(_record));
+    }
+
+    static void put24(uint8_t *p, int32_t v) {
+        p[0] = v;
+        p[1] = v >> 8;
+        p[2] = v >> 16;
+    }
+
+    static int32_t get24(const uint8_t *p) {
+        return (int32_t)((uint32_t)p[2] << 24 | (uint32_t)p[1] << 16 |
+                         (uint16_t)p[0] << 8) >> 8;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    CRC-8 of a record, polynomial 0x07, up to the check and the
+                  sequence number without the mark
+        @param    r
+                  The record
+        @return   The CRC
+    */
+    /**************************************************************************/
+    static uint8_t crc(const _record &r) {
+        const uint8_t *p = (const uint8_t *)&r;
+        uint8_t crc = 0;
+        for (uint8_t i = 0; i <= offsetof(_record, check); i++) {
+            crc ^= i < offsetof(_record, check) ? p[i] : r.seq & JOURNAL_SEQ;
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+            }
+        }
+        return crc;
+    }
+};
+
+position_journal journal;
+
+#endif /* JOURNAL_H_ */
@@ -0,0 +1,274 @@
+/*!
+* @file orbit.h
+*
+* It is the on-board satellite tracking, the TLE is parsed as it arrives,
+* propagated with SGP4 and the look angles feed the trajectory queue.
+*
+* It is built with ENABLE_SGP4, 0 by default. The objects take 240 bytes
+* of RAM, the flash of the propagator and of the float math of avr-libc is
+* not measured, so check both with avr-size before it is turned on with
+* the other features. The host build has a 32-bit int, the integer math
+* here keeps to the types of stdint.h so it does not depend on it.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef ORBIT_H_
+#define ORBIT_H_
+
+#include "hal.h"
+#include "sgp4.h"
+#include "trajectory.h"
+#include "utc.h"
+
+#define ORBIT_STEP   1000     ///< Time between the propagated samples in ms
+#define TLE_COLUMNS  69       ///< Length of a TLE line
+
+/** Fields of the TLE */
+enum _tle_field {
+    tle_year, tle_doy, tle_doy_fraction, tle_bstar, tle_bstar_exp,
+    tle_incl, tle_node, tle_ecc, tle_argp, tle_anomaly, tle_motion,
+    tle_fields
+};
+
+/** Columns of a TLE field, 0 based and inclusive */
+struct _tle_column {
+    uint8_t line;
+    uint8_t first;
+    uint8_t last;
+    uint8_t field;
+};
+
+/** Position of the fields in the two lines of a TLE */
+const _tle_column tle_columns[] PROGMEM = {
+    { 1, 18, 19, tle_year }, { 1, 20, 22, tle_doy },
+    { 1, 24, 31, tle_doy_fraction }, { 1, 53, 58, tle_bstar },
+    { 1, 59, 60, tle_bstar_exp }, { 2, 8, 15, tle_incl },
+    { 2, 17, 24, tle_node }, { 2, 26, 32, tle_ecc },
+    { 2, 34, 41, tle_argp }, { 2, 43, 50, tle_anomaly },
+    { 2, 52, 62, tle_motion }
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the on-board tracking of a satellite.
+              The TLE lines are fed byte per byte, so no line buffer is
+              needed
+*/
+/**************************************************************************/
+class orbit {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Start a TLE line
+        @param    line
+                  The first character of the line, '1' or '2'
+    */
+    /**************************************************************************/
+    void begin_line(char line) {
+        _line = line - '0';
+        _column = 0;
+        _checksum = 0;
+        _dot = false;
+        if (_line == 1) {
+            _tle = false;
+            _line1 = false;
+        }
+        feed(line);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Feed a character of the current TLE line
+        @param    c
+                  The character
+    */
+    /**************************************************************************/
+    void feed(char c) {
+        if (_column < TLE_COLUMNS - 1) {
+            // Modulo 10 at each digit, the sum of a line reaches 612
+            if (isdigit(c)) {
+                _checksum = (_checksum + (c - '0')) % 10;
+            } else if (c == '-') {
+                _checksum = (_checksum + 1) % 10;
+            }
+        } else if (_column == TLE_COLUMNS - 1) {
+            _checksum = (_checksum == (uint8_t)(c - '0'));
+        }
+        for (uint8_t i = 0; i < tle_fields; i++) {
+            const _tle_column *col = &tle_columns[i];
+            if (pgm_read_byte(&col->line) != _line ||
+                _column < pgm_read_byte(&col->first) ||
+                _column > pgm_read_byte(&col->last)) {
+                continue;
+            }
+            uint8_t f = pgm_read_byte(&col->field);
+            if (_column == pgm_read_byte(&col->first)) {
+                _values[f] = 0;
+                _decimals[f] = 0;
+                _negative &= ~_BV(f);
+                _dot = false;
+            }
+            if (isdigit(c)) {
+                _values[f] = _values[f] * 10 + (c - '0');
+                _decimals[f] += _dot;
+            } else if (c == '.') {
+                _dot = true;
+            } else if (c == '-') {
+                _negative |= _BV(f);
+            }
+            break;
+        }
+        if (_column < UINT8_MAX) {
+            _column++;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    End the current TLE line. The elements are loaded in the
+                  propagator when a valid line 2 follows a valid line 1
+        @return   The number of the line if it is valid, 0 if not
+    */
+    /**************************************************************************/
+    uint8_t end_line() {
+        bool valid = _column == TLE_COLUMNS && _checksum == 1;
+        if (_line == 1) {
+            _line1 = valid;
+            return valid ? 1 : 0;
+        }
+        if (!valid || !_line1) {
+            return 0;
+        }
+        _line1 = false;
+        _tle = load();
+        return _tle ? 2 : 0;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the location of the ground station
+        @param    lat
+                  Latitude in deg
+        @param    lon
+                  Longitude in deg, east positive
+        @param    alt
+                  Altitude in m
+    */
+    /**************************************************************************/
+    void set_station(float lat, float lon, float alt) {
+        _station.set(lat, lon, alt);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the ground station
+        @return   The observer
+    */
+    /**************************************************************************/
+    observer<float> &station() {
+        return _station;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Start the tracking, the trajectory queue is refilled with
+                  the propagated samples from now on
+        @return   False if there is no TLE or the clock is not set
+    */
+    /**************************************************************************/
+    bool start() {
+        if (!_tle || !utc_clock.valid()) {
+            return false;
+        }
+        track.clear();
+        _next = track.now();
+        return true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Propagate the next sample if there is room in the
+                  trajectory queue. It is called from the loop, one
+                  propagation per call bounds the loop time
+        @return   False if the propagation fails, e.g. the satellite decayed
+    */
+    /**************************************************************************/
+    bool fill() {
+        if (track.free() == 0) {
+            return true;
+        }
+        int32_t day;
+        uint32_t ms;
+        utc_clock.now(_next - track.now(), &day, &ms);
+        float tsince = (day - _epoch_day) * 1440.0 +
+                       ((int32_t)ms - (int32_t)_epoch_ms) / 60000.0;
+        float r[3], az, el;
+        if (_model.propagate(tsince, r) != sgp4_no_error) {
+            return false;
+        }
+        _station.look(r, observer<float>::sidereal(day, ms), &az, &el);
+        track.add(_next, lround(az * 1000), lround(el * 1000));
+        _next += ORBIT_STEP;
+        return true;
+    }
+
+private:
+    sgp4<float> _model;
+    observer<float> _station;
+    int32_t _values[tle_fields];
+    uint8_t _decimals[tle_fields];
+    uint16_t _negative;
+    uint8_t _line, _column, _checksum;
+    bool _dot;
+    bool _line1 = false, _tle = false;
+    int32_t _epoch_day;
+    uint32_t _epoch_ms, _next;
+
+    /**************************************************************************/
+    /*!
+        @brief    Get a TLE field as a number
+        @param    f
+                  The field
+        @return   The number, with its decimal point
+    */
+    /**************************************************************************/
+    float number(uint8_t f) {
+        float x = _values[f];
+        for (uint8_t i = 0; i < _decimals[f]; i++) {
+            x /= 10;
+        }
+        return (_negative & _BV(f)) ? -x : x;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Load the parsed elements in the propagator
+        @return   False if the elements are not valid for SGP4
+    */
+    /**************************************************************************/
+    bool load() {
+        // Epochs of the 20th century are not supported by the clock
+        if (!utc::day_number(_values[tle_year] * 1000L + _values[tle_doy],
+                             &_epoch_day)) {
+            return false;
+        }
+        // 8 decimals of day to ms, 0.864 ms per unit
+        uint32_t fraction = _values[tle_doy_fraction];
+        _epoch_ms = fraction / 125 * 108 + fraction % 125 * 108 / 125;
+        float bstar = number(tle_bstar) * 1.0e-5 *
+                      pow(10, number(tle_bstar_exp));
+        float ecc = number(tle_ecc) * 1.0e-7;
+        float motion = number(tle_motion) * SGP4_TWO_PI / 1440;
+        return _model.init(bstar, ecc, number(tle_argp) * SGP4_DEG,
+                           number(tle_incl) * SGP4_DEG,
+                           number(tle_anomaly) * SGP4_DEG, motion,
+                           number(tle_node) * SGP4_DEG) == sgp4_no_error;
+    }
+};
+
+orbit sat;
+
+#endif /* ORBIT_H_ */
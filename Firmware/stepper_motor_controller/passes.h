@@ -0,0 +1,340 @@
+/*!
+* @file passes.h
+*
+* It is the storage of the upcoming passes in EEPROM, as Chebyshev
+* coefficients, and their execution without the client.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef PASSES_H_
+#define PASSES_H_
+
+#include "hal.h"
+#include "trajectory.h"
+#include "utc.h"
+
+#define PASS_BASE      0     ///< First EEPROM byte of the pass storage
+#define PASS_SIZE      896   ///< EEPROM bytes of the pass storage
+#define PASS_ORDER_MAX 8     ///< Maximum coefficients per axis of a segment
+#define PASS_RECORD    16    ///< Maximum data bytes of a HEX record
+#define PASS_STEP      1000  ///< Time between the evaluated samples in ms
+#define PASS_LEAD      60000 ///< Time before a pass to move to its start in ms
+#define PASS_CHECK     1000  ///< Period of the search for a due pass in ms
+#define PASS_SCAN      10000 ///< Time between the samples of the pass extent in ms
+
+/**
+ * Header of a pass in EEPROM, it is followed by the segments. A segment is
+ * its duration in s, uint8_t, then the order coefficients of the azimuth
+ * and the order coefficients of the elevation, int16_t in 0.01 deg. The
+ * azimuth of a segment is relative to the base of the pass. A header with
+ * 0xFF segments ends the storage. It is packed, as the AVR, to keep the
+ * layout on a host build.
+ */
+struct __attribute__((packed)) _pass_header {
+    uint8_t segments; ///< Number of segments
+    uint8_t order;    ///< Coefficients per axis of each segment
+    uint16_t day;     ///< Start, days since 2000-01-01
+    uint32_t ms;      ///< Start, time of the day in ms
+    uint16_t az;      ///< Azimuth base in 0.01 deg, 0-35999
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the passes in EEPROM. The client
+              writes the storage with Intel HEX records, the addresses are
+              relative to PASS_BASE. A due pass is evaluated with the
+              Clenshaw recurrence into the trajectory queue
+*/
+/**************************************************************************/
+class pass_store {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Start a HEX record, after the ':'
+    */
+    /**************************************************************************/
+    void begin_record() {
+        _nibbles = 0;
+        _bad = false;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Feed a character of the current HEX record
+        @param    c
+                  The character
+    */
+    /**************************************************************************/
+    void feed(char c) {
+        uint8_t nibble;
+        if (c >= '0' && c <= '9') {
+            nibble = c - '0';
+        } else if (c >= 'A' && c <= 'F') {
+            nibble = c - 'A' + 10;
+        } else if (c >= 'a' && c <= 'f') {
+            nibble = c - 'a' + 10;
+        } else {
+            _bad = true;
+            return;
+        }
+        if (_nibbles >= 2 * sizeof(_record)) {
+            _bad = true;
+            return;
+        }
+        uint8_t i = _nibbles / 2;
+        _record[i] = (_nibbles & 1) ? (_record[i] << 4 | nibble) : nibble;
+        _nibbles++;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    End the current HEX record and start the write of its data
+                  to EEPROM, write() writes it
+        @return   False if the record is invalid
+    */
+    /**************************************************************************/
+    bool end_record() {
+        uint8_t len = _nibbles / 2;
+        if (_bad || (_nibbles & 1) || len < 5 || _record[0] != len - 5) {
+            return false;
+        }
+        uint8_t sum = 0;
+        for (uint8_t i = 0; i < len; i++) {
+            sum += _record[i];
+        }
+        if (sum != 0) {
+            return false;
+        }
+        switch (_record[3]) {
+        case 0:
+            {
+                // Data record
+                uint16_t addr = _record[1] << 8 | _record[2];
+                if (addr + _record[0] > PASS_SIZE) {
+                    return false;
+                }
+                _write_addr = PASS_BASE + addr;
+                _write_len = _record[0];
+                _written = 0;
+                return true;
+            }
+        case 1:
+            // End of file record
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Write the next byte of the ended record when the EEPROM is
+                  ready, called from the loop. The record is kept until it is
+                  written, the next one must wait
+        @return   True when the whole record is written
+    */
+    /**************************************************************************/
+    bool write() {
+        if (_written < _write_len && eeprom_is_ready()) {
+            eeprom_update_byte((uint8_t *)(_write_addr + _written),
+                               _record[4 + _written]);
+            _written++;
+        }
+        return _written == _write_len;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Count the stored passes
+        @return   Number of passes
+    */
+    /**************************************************************************/
+    uint8_t count() {
+        _pass_header h;
+        uint8_t n = 0;
+        for (uint16_t addr = 0; header(addr, &h); addr = next(addr, h)) {
+            n++;
+        }
+        return n;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Start a pass if it begins within PASS_LEAD. The trajectory
+                  queue holds the first sample until the start, so the
+                  rotator waits there
+        @return   True if a pass started
+    */
+    /**************************************************************************/
+    bool due() {
+        if (!utc_clock.valid() || millis() - _check < PASS_CHECK) {
+            return false;
+        }
+        _check = millis();
+        _pass_header h;
+        for (uint16_t addr = 0; header(addr, &h); addr = next(addr, h)) {
+            int32_t to_start = -utc_clock.since(h.day, h.ms);
+            if (to_start > 0 && to_start <= PASS_LEAD) {
+                _addr = addr;
+                _pass = h;
+                _duration = 0;
+                for (uint8_t i = 0; i < h.segments; i++) {
+                    _duration += segment_duration(i);
+                }
+                _next = 0;
+                track.clear();
+                // The whole pass keeps one turn of the cable wrap
+                int32_t az, el, lo, hi;
+                evaluate(0, &lo, &el);
+                hi = lo;
+                for (uint32_t t = PASS_SCAN; t < _duration + PASS_SCAN;
+                     t += PASS_SCAN) {
+                    evaluate(min(t, _duration), &az, &el);
+                    lo = min(lo, az);
+                    hi = max(hi, az);
+                }
+                track.set_extent(lo, hi);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Evaluate the next sample of the started pass if there is
+                  room in the trajectory queue
+        @return   False when the pass is over
+    */
+    /**************************************************************************/
+    bool fill() {
+        int32_t offset = utc_clock.since(_pass.day, _pass.ms);
+        if (offset > (int32_t)_duration) {
+            return false;
+        }
+        if (track.free() == 0 || _next > _duration) {
+            return true;
+        }
+        int32_t az, el;
+        evaluate(_next, &az, &el);
+        track.add(track.now() + (int32_t)(_next - offset), az, el);
+        if (_next == _duration) {
+            _next++;
+        } else {
+            _next = min(_next + PASS_STEP, _duration);
+        }
+        return true;
+    }
+
+private:
+    uint8_t _record[PASS_RECORD + 5];
+    uint8_t _nibbles;
+    bool _bad;
+    uint16_t _write_addr;    ///< EEPROM address of the data of the record
+    uint8_t _write_len = 0;  ///< Data bytes of the record
+    uint8_t _written = 0;    ///< Data bytes of the record in EEPROM
+    _pass_header _pass;
+    uint16_t _addr;
+    uint32_t _duration, _next, _check;
+
+    /**************************************************************************/
+    /*!
+        @brief    Read and check the header of a pass
+        @param    addr
+                  Address of the pass, relative to PASS_BASE
+        @param    h
+                  The header
+        @return   False at the end of the storage
+    */
+    /**************************************************************************/
+    bool header(uint16_t addr, _pass_header *h) {
+        if (addr + sizeof(_pass_header) > PASS_SIZE) {
+            return false;
+        }
+        eeprom_read_block(h, (const void *)(PASS_BASE + addr),
+                          sizeof(_pass_header));
+        if (h->segments == 0 || h->segments == 0xFF || h->order == 0 ||
+            h->order > PASS_ORDER_MAX || next(addr, *h) > PASS_SIZE) {
+            return false;
+        }
+        // A segment of no duration has no point to evaluate
+        uint16_t segment = PASS_BASE + addr + sizeof(_pass_header);
+        for (uint8_t i = 0; i < h->segments; i++) {
+            if (eeprom_read_byte((const uint8_t *)segment) == 0) {
+                return false;
+            }
+            segment += 1 + 4 * h->order;
+        }
+        return true;
+    }
+
+    static uint16_t next(uint16_t addr, const _pass_header &h) {
+        return addr + sizeof(_pass_header) +
+               h.segments * (1 + 4 * h.order);
+    }
+
+    uint16_t segment_addr(uint8_t i) {
+        return PASS_BASE + _addr + sizeof(_pass_header) +
+               i * (1 + 4 * _pass.order);
+    }
+
+    uint32_t segment_duration(uint8_t i) {
+        return eeprom_read_byte((const uint8_t *)segment_addr(i)) * 1000UL;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Evaluate the started pass
+        @param    offset
+                  Time since the start of the pass in ms
+        @param    az
+                  Azimuth in mdeg, unwrapped
+        @param    el
+                  Elevation in mdeg
+    */
+    /**************************************************************************/
+    void evaluate(uint32_t offset, int32_t *az, int32_t *el) {
+        uint8_t i = 0;
+        uint32_t duration = segment_duration(0);
+        while (offset > duration && i + 1 < _pass.segments) {
+            offset -= duration;
+            duration = segment_duration(++i);
+        }
+        int16_t c[2 * PASS_ORDER_MAX];
+        eeprom_read_block(c, (const void *)(segment_addr(i) + 1),
+                          4 * _pass.order);
+        float x = 2.0 * offset / duration - 1;
+        x = constrain(x, -1, 1);
+        *az = _pass.az * 10L + lround(clenshaw(c, _pass.order, x) * 10);
+        *el = lround(clenshaw(c + _pass.order, _pass.order, x) * 10);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Sum a Chebyshev series with the Clenshaw recurrence
+        @param    c
+                  The coefficients
+        @param    n
+                  Number of coefficients
+        @param    x
+                  The point, -1 to 1
+        @return   The sum
+    */
+    /**************************************************************************/
+    static float clenshaw(const int16_t *c, uint8_t n, float x) {
+        float b1 = 0, b2 = 0;
+        for (uint8_t k = n - 1; k > 0; k--) {
+            float b = c[k] + 2 * x * b1 - b2;
+            b2 = b1;
+            b1 = b;
+        }
+        return c[0] + x * b1 - b2;
+    }
+};
+
+pass_store passes;
+
+#endif /* PASSES_H_ */
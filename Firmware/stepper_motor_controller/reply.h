@@ -0,0 +1,206 @@
+/*!
+* @file reply.h
+*
+* It is a heap-free line writer for easycomm responses.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef REPLY_H_
+#define REPLY_H_
+
+#include "hal.h"
+#include "uart.h"
+
+#define REPLY_SIZE 48 ///< Size of the static reply line buffer, the longest is the pushed telemetry
+
+/**************************************************************************/
+/*!
+    @brief    Class that formats one response line into a fixed buffer,
+              without String objects or heap allocation, and queues it to
+              the UART
+*/
+/**************************************************************************/
+class reply {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Start a new response line
+        @param    prefix
+                  The response prefix, e.g. "AZ" or "IP0,"
+    */
+    /**************************************************************************/
+    void begin(const char *prefix) {
+        _len = 0;
+#if ENABLE_RS485
+        if (_node != 0) {
+            put('#');
+            digits(_node, 1);
+            put(' ');
+        }
+#endif
+        text(prefix);
+    }
+
+#if ENABLE_RS485
+    /**************************************************************************/
+    /*!
+        @brief    Set the node of the next replies on the RS485 bus, they
+                  start with its address, e.g. "#2 AZ10.0 EL20.0"
+        @param    node
+                  The node, 0 for a broadcast, it has no reply
+    */
+    /**************************************************************************/
+    void node(uint8_t node) {
+        _node = node;
+    }
+#endif
+
+    /**************************************************************************/
+    /*!
+        @brief    Append a string to the response line
+        @param    str
+                  A null terminated string
+    */
+    /**************************************************************************/
+    void text(const char *str) {
+        while (*str != '\0' && _len < REPLY_SIZE - 1) {
+            _buffer[_len++] = *str++;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Append a signed integer to the response line
+        @param    value
+                  The integer to format in decimal
+    */
+    /**************************************************************************/
+    void integer(int32_t value) {
+        uint32_t magnitude = value;
+        if (value < 0) {
+            put('-');
+            magnitude = -magnitude;
+        }
+        digits(magnitude, 1);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Append a number in fixed-point notation to the response line
+        @param    value
+                  The number to format
+        @param    decimals
+                  Number of decimal places, 0-4
+    */
+    /**************************************************************************/
+    void fixed(double value, uint8_t decimals) {
+        uint16_t scale = 1;
+        for (uint8_t i = 0; i < decimals; i++) {
+            scale *= 10;
+        }
+        // Round half away from zero, as the Arduino print does
+        scaled((int32_t)(value * scale + (value < 0 ? -0.5 : 0.5)), decimals);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Append an integer number of fractional units in fixed-point
+                  notation to the response line, without rounding errors
+        @param    value
+                  The number in units of the last decimal, e.g. ms
+        @param    decimals
+                  Number of decimal places, 0-4
+    */
+    /**************************************************************************/
+    void scaled(int32_t value, uint8_t decimals) {
+        uint16_t scale = 1;
+        for (uint8_t i = 0; i < decimals; i++) {
+            scale *= 10;
+        }
+        uint32_t magnitude = value;
+        if (value < 0) {
+            put('-');
+            magnitude = -magnitude;
+        }
+        digits(magnitude / scale, 1);
+        if (decimals > 0) {
+            put('.');
+            digits(magnitude % scale, decimals);
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Append a number in thousandths, e.g. mdeg, rounded to fewer
+                  decimal places, in fixed-point notation
+        @param    value
+                  The number in thousandths
+        @param    decimals
+                  Number of decimal places, 0-3
+    */
+    /**************************************************************************/
+    void milli(int32_t value, uint8_t decimals) {
+        int16_t scale = 1;
+        for (uint8_t i = decimals; i < 3; i++) {
+            scale *= 10;
+        }
+        // Round half away from zero, as fixed()
+        value += (value < 0 ? -scale : scale) / 2;
+        scaled(value / scale, decimals);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Terminate the response line and queue it to the UART. The
+                  line is dropped if the TX ring is full, the client will
+                  poll again
+        @return   True if the line is queued
+    */
+    /**************************************************************************/
+    bool send() {
+#if ENABLE_RS485
+        if (_node == 0) {
+            // A broadcast, the nodes would answer at the same time
+            _len = 0;
+            return true;
+        }
+#endif
+        _buffer[_len++] = '\n';
+        bool queued = uart0.write((const uint8_t *)_buffer, _len);
+        _len = 0;
+        return queued;
+    }
+
+private:
+    char _buffer[REPLY_SIZE];
+    uint8_t _len = 0;
+#if ENABLE_RS485
+    uint8_t _node = 0;
+#endif
+
+    void put(char c) {
+        if (_len < REPLY_SIZE - 1) {
+            _buffer[_len++] = c;
+        }
+    }
+
+    void digits(uint32_t value, uint8_t width) {
+        char tmp[10];
+        uint8_t n = 0;
+        do {
+            tmp[n++] = '0' + value % 10;
+            value /= 10;
+        } while (value != 0);
+        while (n < width) {
+            tmp[n++] = '0';
+        }
+        while (n > 0) {
+            put(tmp[--n]);
+        }
+    }
+};
+
+#endif /* REPLY_H_ */
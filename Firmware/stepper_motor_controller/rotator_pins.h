@@ -26,7 +26,7 @@
 #define SW1 8 ///< Digital input, to read the status of end-stop for motor 1
 #define SW2 9 ///< Digital input, to read the status of end-stop for motor 2
 
-#define RS485_DIR 2 ///< Digital output, to set the direction of RS485 communication
+#define RS485_DIR 12 ///< Digital output, to set the direction of RS485 communication
 
 #define SDA_PIN  ///< I2C data pin
 #define SCL_PIN  ///< I2C clock pin
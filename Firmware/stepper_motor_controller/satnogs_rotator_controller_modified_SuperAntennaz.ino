@@ -12,9 +12,9 @@
  *
  * @section dependencies Dependencies
  *
- * This firmware depends on <a href="http://www.airspayce.com/mikem/arduino/AccelStepper/index.htmlhttp://www.airspayce.com/mikem/arduino/AccelStepper/index.html">
- * AccelStepper library</a> being present on your system. Please make sure you
- * have installed the latest version before using this firmware.
+ * The steps are generated by the Timer1 interrupt (stepper.h) and the
+ * serial port is driven by the USART0 interrupts (uart.h), so this firmware
+ * does not depend on the AccelStepper library or on the Arduino Serial.
  *
  * @section license License
  *
@@ -25,36 +25,54 @@
 #define SAMPLE_TIME        0.1   ///< Control loop in s
 #define RATIO              80    ///< Gear ratio of rotator gear box                                 default 54
 #define MICROSTEP          2     ///< Set Microstep
-#define MIN_PULSE_WIDTH    20    ///< In microsecond for AccelStepper
-#define MAX_SPEED          1600  ///< In steps/s, consider the microstep
+#define MAX_SPEED          1600  ///< In steps/s, consider the microstep, up to STEP_MAX_SPEED
+#define STEP_FREQ          20000 ///< Step interrupt in Hz, twice MAX_SPEED or more, 40000 for 16 microsteps at full speed, the profiles run with the interrupts on
 #define MAX_ACCELERATION   1600  ///< In steps/s^2, consider the microstep
+#define MAX_JERK           20000 ///< In steps/s^3 for S-curve profile, consider the microstep
 #define SPR                400L ///< Step Per Revolution, consider the microstep
-#define MIN_M1_ANGLE       0     ///< Minimum angle of azimuth
-#define MAX_M1_ANGLE       360   ///< Maximum angle of azimuth
+#define MIN_M1_ANGLE       0     ///< Minimum angle of azimuth, cable position of the end-stop, e.g. -180 with 540 for a turn of overlap
+#define MAX_M1_ANGLE       360   ///< Maximum angle of azimuth, cable position
 #define MIN_M2_ANGLE       0     ///< Minimum angle of elevation
 #define MAX_M2_ANGLE       180   ///< Maximum angle of elevation
+#define BACKLASH_M1        0     ///< Backlash of the azimuth gear in mdeg, CW18
+#define BACKLASH_M2        0     ///< Backlash of the elevation gear in mdeg, CW19
 #define DEFAULT_HOME_STATE HIGH  ///< Change to LOW according to Home sensor
-#define HOME_DELAY         12000 ///< Time for homing Deceleration in millisecond
+#define TRACK_PERIOD       10    ///< Interpolation period of trajectory in millisecond
+#define ENABLE_SGP4        0     ///< On-board SGP4 tracking from a TLE, 1 to enable, see orbit.h
+#define ENABLE_TIMING      0     ///< Loop and step timing histograms, TM command, 1 to measure
+#define ENABLE_ENCODER     0     ///< I2C sensors, step loss correction with AS5601 encoders on the axis and TC74 temperature, 1 to enable
+#define ENABLE_BINARY      0     ///< Binary protocol beside easycomm, BP command, 1 to enable
+#define ENABLE_RS485       0     ///< Addressed multi-drop RS485 bus, the transceiver direction on RS485_DIR, 1 to enable
+#define RS485_NODE         1     ///< Address of this rotator on the RS485 bus, 1-254
 
-#include <AccelStepper.h>
-#include <Wire.h>
+#include "hal.h"
 //#include <globals.h>
 #include "easycomm.h"
 #include "rotator_pins.h"
-//#include <rs485.h>
 #include "endstop.h"
-//#include <watchdog.h>
+#include "stepper.h"
+#include "homing.h"
+#include "journal.h"
+#include "units.h"
+#include "flip.h"
+#include "deadline.h"
+
+static_assert(MAX_SPEED <= STEP_MAX_SPEED, "MAX_SPEED needs a higher STEP_FREQ");
 
 uint32_t t_run = 0; // run time of uC
 easycomm comm;
-AccelStepper stepper_az(1, 3, 2);
-AccelStepper stepper_el(1, 5, 4);
 endstop switch_az(SW1, DEFAULT_HOME_STATE), switch_el(SW2, DEFAULT_HOME_STATE);
-//wdt_timer wdt;
+home_axis home_az(stepper_az, switch_az), home_el(stepper_el, switch_el);
 
 enum _rotator_error homing(int32_t seek_az, int32_t seek_el);
-int32_t deg2step(float deg);
-float step2deg(int32_t step);
+void resume();
+#if ENABLE_ENCODER
+bool zero_encoders();
+bool check_encoders();
+#endif
+void follow_trajectory();
+void run_speed(stepper &axis, int32_t speed, int32_t setpoint, int32_t min,
+               int32_t max);
 
 void setup() {
     // Homing switch
@@ -64,37 +82,65 @@ void setup() {
     // Serial Communication
     comm.easycomm_init();
 
-    // Stepper Motor setup
-    stepper_az.setEnablePin(MOTOR_EN);
-    stepper_az.setPinsInverted(false, false, true);
-    stepper_az.enableOutputs();
-    stepper_az.setMaxSpeed(MAX_SPEED);
-    stepper_az.setAcceleration(MAX_ACCELERATION);
-    stepper_az.setMinPulseWidth(MIN_PULSE_WIDTH);
-    stepper_el.setPinsInverted(false, false, true);
-    stepper_el.enableOutputs();
-    stepper_el.setMaxSpeed(MAX_SPEED);
-    stepper_el.setAcceleration(MAX_ACCELERATION);
-    stepper_el.setMinPulseWidth(MIN_PULSE_WIDTH);
-
-    // Initialize WDT
-   // wdt.watchdog_init();
+    // Stepper Motor setup, the enable pin is active low
+    pinMode(MOTOR_EN, OUTPUT);
+    digitalWrite(MOTOR_EN, LOW);
+    stepper_az.init();
+    stepper_az.set_max_speed(MAX_SPEED);
+    stepper_az.set_acceleration(MAX_ACCELERATION);
+    stepper_el.init();
+    stepper_el.set_max_speed(MAX_SPEED);
+    stepper_el.set_acceleration(MAX_ACCELERATION);
+    stepper_az.set_backlash(mdeg2step(BACKLASH_M1));
+    stepper_el.set_backlash(mdeg2step(BACKLASH_M2));
+    rotator.jerk = MAX_JERK;
+    flip.set_rate(step2mdeg(MAX_SPEED), TRACK_PERIOD);
+    wrap.set_range(MIN_M1_ANGLE * 1000L, MAX_M1_ANGLE * 1000L);
+    wrap.set_motion(step2mdeg(MAX_SPEED), step2mdeg(MAX_ACCELERATION));
+    stepper_timer_init();
+#if ENABLE_ENCODER
+    sensors.init();
+#endif
+
+    // Skip the homing after a clean restart
+    resume();
+
+    // Start the watchdog, a round of the loop has DEADLINE_TIMEOUT, and
+    // report the watchdog reset before this start until PM reads it
+    if (deadline.init()) {
+        rotator.rotator_error = wdt_error;
+    }
 }
 
 void loop() {
-    // Update WDT
-   // wdt.watchdog_reset();
+    // Feed the watchdog
+    deadline.loop();
+#if ENABLE_TIMING
+    timing.loop();
+#endif
+    // End the UTC when it is stale
+    utc_clock.loop();
+
+    deadline.start(deadline_sensors);
+#if ENABLE_ENCODER
+    // Read the I2C sensors
+    sensors.poll();
+#endif
 
     // Get end stop status
     rotator.switch_az = switch_az.get_state();
     rotator.switch_el = switch_el.get_state();
 
     // Run easycomm implementation
+    deadline.start(deadline_comm);
     comm.easycomm_proc();
 
     // Get position of both axis
-    control_az.input = step2deg(stepper_az.currentPosition());
-    control_el.input = step2deg(stepper_el.currentPosition());
+    deadline.start(deadline_stepping);
+    control_az.input = step2mdeg(stepper_az.position());
+    control_el.input = step2mdeg(stepper_el.position());
+    control_az.speed = speed2mdeg(stepper_az.speed());
+    control_el.speed = speed2mdeg(stepper_el.speed());
 
     // Check rotator status
     if (rotator.rotator_status != error) {
@@ -102,10 +148,11 @@ void loop() {
             // Check home flag
             rotator.control_mode = position;
             // Homing
-            rotator.rotator_error = homing(deg2step(-MAX_M1_ANGLE),
-                                           deg2step(-MAX_M2_ANGLE));
-            if (rotator.rotator_error == no_error) {
-                // No error
+            deadline.start(deadline_homing);
+            if (homing(mdeg2step((MIN_M1_ANGLE - MAX_M1_ANGLE) * 1000L),
+                       mdeg2step((MIN_M2_ANGLE - MAX_M2_ANGLE) * 1000L)) ==
+                no_error) {
+                // No error, a watchdog reset stays in the error register
                 rotator.rotator_status = idle;
                 rotator.homing_flag = true;
             } else {
@@ -114,25 +161,82 @@ void loop() {
                 rotator.rotator_error = homing_error;
             }
         } else {
-            // Control Loop
-            stepper_az.moveTo(deg2step(control_az.setpoint));
-            stepper_el.moveTo(deg2step(control_el.setpoint));
+#if ENABLE_ENCODER
+            if (!check_encoders()) {
+                // The step loss is not recoverable
+                rotator.rotator_status = error;
+                rotator.rotator_error = sensor_error;
+                return;
+            }
+#endif
+            // Control Loop, the timer interrupt moves the motors
+            if (rotator.autonomous && rotator.control_mode == position &&
+                passes.due()) {
+                rotator.control_mode = playback;
+            }
+            if (rotator.control_mode == playback && !passes.fill()) {
+                // The pass is over, go to park position
+                rotator.control_mode = position;
+                control_az.setpoint = rotator.park_az;
+                control_el.setpoint = rotator.park_el;
+            }
+#if ENABLE_SGP4
+            if (rotator.control_mode == prediction && !sat.fill()) {
+                // The propagation failed, hold the position
+                rotator.control_mode = position;
+                control_az.setpoint = control_az.input;
+                control_el.setpoint = control_el.input;
+            }
+#endif
+            if (rotator.control_mode == tracking ||
+                rotator.control_mode == prediction ||
+                rotator.control_mode == playback) {
+                follow_trajectory();
+            } else {
+                flip.reset();
+                wrap.reset();
+            }
+            uint32_t jerk = rotator.profile == s_curve ? rotator.jerk : 0;
+            stepper_az.set_jerk(jerk);
+            stepper_el.set_jerk(jerk);
+            if (rotator.control_mode == speed) {
+                stepper_az.set_ratio(RATIO_ONE);
+                stepper_el.set_ratio(RATIO_ONE);
+                run_speed(stepper_az, control_az.setpoint_speed,
+                          control_az.setpoint, MIN_M1_ANGLE, MAX_M1_ANGLE);
+                run_speed(stepper_el, control_el.setpoint_speed,
+                          control_el.setpoint, MIN_M2_ANGLE, MAX_M2_ANGLE);
+            } else if (rotator.coordinated &&
+                       rotator.control_mode == position) {
+                stepper_az.set_speed_limit(0);
+                stepper_el.set_speed_limit(0);
+                move_coordinated(stepper_az, mdeg2step(control_az.setpoint),
+                                 stepper_el, mdeg2step(control_el.setpoint));
+            } else {
+                stepper_az.set_speed_limit(0);
+                stepper_el.set_speed_limit(0);
+                stepper_az.set_ratio(RATIO_ONE);
+                stepper_el.set_ratio(RATIO_ONE);
+                stepper_az.move_to(mdeg2step(control_az.setpoint));
+                stepper_el.move_to(mdeg2step(control_el.setpoint));
+            }
             rotator.rotator_status = pointing;
-            // Move azimuth and elevation motors
-            stepper_az.run();
-            stepper_el.run();
             // Idle rotator
-            if (stepper_az.distanceToGo() == 0 && stepper_el.distanceToGo() == 0) {
+            if (!stepper_az.is_running() && !stepper_el.is_running()) {
                 rotator.rotator_status = idle;
             }
+            // Record the position at rest for a restart
+            journal.update(rotator.rotator_status != idle, control_az.input,
+                           control_el.input);
         }
     } else {
         // Error handler, stop motors and disable the motor driver
-        stepper_az.stop();
-        stepper_az.disableOutputs();
-        stepper_el.stop();
-        stepper_el.disableOutputs();
-        if (rotator.rotator_error != homing_error) {
+        stepper_az.halt();
+        stepper_el.halt();
+        digitalWrite(MOTOR_EN, HIGH);
+        journal.invalidate();
+        if (rotator.rotator_error != homing_error &&
+            rotator.rotator_error != sensor_error) {
             // Reset error according to error value
             rotator.rotator_error = no_error;
             rotator.rotator_status = idle;
@@ -142,8 +246,9 @@ void loop() {
 
 /**************************************************************************/
 /*!
-    @brief    Move both axis with one direction in order to find home position,
-              end-stop switches
+    @brief    Home both axis at the same time to their end-stops, with a fast
+              seek, a back-off and a slow approach, see homing.h. It returns
+              as soon as both axis stand at the home position
     @param    seek_az
               Steps to find home position for azimuth axis
     @param    seek_el
@@ -152,75 +257,191 @@ void loop() {
 */
 /**************************************************************************/
 enum _rotator_error homing(int32_t seek_az, int32_t seek_el) {
-    bool isHome_az = false;
-    bool isHome_el = false;
-
-    // Move motors to "seek" position
-    stepper_az.moveTo(seek_az);
-    stepper_el.moveTo(seek_el);
+    journal.invalidate();
+    home_az.start(MIN_M1_ANGLE * 1000L, seek_az, MAX_SPEED);
+    home_el.start(MIN_M2_ANGLE * 1000L, seek_el, MAX_SPEED);
 
     // Homing loop
-    while (isHome_az == false || isHome_el == false) {
-        // Update WDT
-       // wdt.watchdog_reset();
-        if (switch_az.get_state() == true && !isHome_az) {
-            // Find azimuth home
-            stepper_az.moveTo(stepper_az.currentPosition());
-            isHome_az = true;
-        }
-        if (switch_el.get_state() == true && !isHome_el) {
-            // Find elevation home
-            stepper_el.moveTo(stepper_el.currentPosition());
-            isHome_el = true;
-        }
+    while (!home_az.done() || !home_el.done()) {
+        // Each round of the homing loop has the deadline
+        deadline.loop();
+        deadline.start(deadline_homing);
+#if ENABLE_ENCODER
+        sensors.poll();
+#endif
+        rotator.switch_az = switch_az.get_state();
+        rotator.switch_el = switch_el.get_state();
         // Check if the rotator goes out of limits or something goes wrong (in
         // mechanical)
-        if ((stepper_az.distanceToGo() == 0 && !isHome_az) ||
-            (stepper_el.distanceToGo() == 0 && !isHome_el)){
+        bool az = home_az.run();
+        bool el = home_el.run();
+        if (!az || !el) {
             return homing_error;
         }
-        // Move motors to "seek" position
-        stepper_az.run();
-        stepper_el.run();
     }
-    // Delay to Deccelerate and homing, to complete the movements
-    uint32_t time = millis();
-    while (millis() - time < HOME_DELAY) {
-       // wdt.watchdog_reset();
-        stepper_az.run();
-        stepper_el.run();
+    // Reset all critical control variables
+    control_az.setpoint = MIN_M1_ANGLE * 1000L;
+    control_el.setpoint = MIN_M2_ANGLE * 1000L;
+#if ENABLE_ENCODER
+    // The encoders count from the home position
+    if (!zero_encoders()) {
+        return sensor_error;
     }
-    // Set the home position and reset all critical control variables
-    stepper_az.setCurrentPosition(0);
-    stepper_el.setCurrentPosition(0);
-    control_az.setpoint = 0;
-    control_el.setpoint = 0;
+#endif
 
     return no_error;
 }
 
 /**************************************************************************/
 /*!
-    @brief    Convert degrees to steps according to step/revolution, rotator
-              gear box ratio and microstep
-    @param    deg
-              Degrees in float format
-    @return   Steps for stepper motor driver, int32_t
+    @brief    Resume from the position of the journal after a clean restart,
+              if the end-stops agree with it, else the loop homes
+*/
+/**************************************************************************/
+void resume() {
+    int32_t az, el;
+
+    if (!journal.restore(&az, &el) ||
+        !home_az.check(MIN_M1_ANGLE * 1000L, az) ||
+        !home_el.check(MIN_M2_ANGLE * 1000L, el)) {
+        return;
+    }
+    stepper_az.set_position(mdeg2step(az));
+    stepper_el.set_position(mdeg2step(el));
+    control_az.setpoint = az;
+    control_el.setpoint = el;
+#if ENABLE_ENCODER
+    // The encoders count from the restored position
+    if (!zero_encoders()) {
+        return;
+    }
+#endif
+    rotator.homing_flag = true;
+}
+
+#if ENABLE_ENCODER
+/**************************************************************************/
+/*!
+    @brief    Set both encoders to the step count, with a reading after the
+              step count was set
+    @return   False if an encoder does not answer
 */
 /**************************************************************************/
-int32_t deg2step(float deg) {
-    return (RATIO * SPR * deg / 360);
+bool zero_encoders() {
+    encoder_az.reset();
+    encoder_el.reset();
+    bool zero_az = false, zero_el = false;
+    uint32_t time = millis();
+    while (!zero_az || !zero_el) {
+        if (millis() - time > ENC_PERIOD) {
+            return false;
+        }
+        sensors.poll();
+        zero_az = zero_az || encoder_az.zero();
+        zero_el = zero_el || encoder_el.zero();
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Compare both axis with their encoders every ENC_PERIOD and
+              correct the missed steps
+    @return   False if the step loss is not recoverable
+*/
+/**************************************************************************/
+bool check_encoders() {
+    static uint32_t t_check = 0;
+
+    if (millis() - t_check < ENC_PERIOD) {
+        return true;
+    }
+    t_check = millis();
+    bool az = encoder_az.check();
+    bool el = encoder_el.check();
+    return az && el;
 }
+#endif
 
 /**************************************************************************/
 /*!
-    @brief    Convert steps to degrees according to step/revolution, rotator
-              gear box ratio and microstep
-    @param    step
-              Steps in int32_t format
-    @return   Degrees in float format
+    @brief    Set the position set points from the streamed trajectory. The
+              set points lead the trajectory by the braking distance at its
+              speed, so the motors cruise along with it instead of stopping
+              at every set point
 */
 /**************************************************************************/
-float step2deg(int32_t step) {
-    return (360.00 * step / (SPR * RATIO));
+void follow_trajectory() {
+    static uint32_t t_track = 0;
+    int32_t az, el;
+    float v_az, v_el;
+
+    if (millis() - t_track < TRACK_PERIOD) {
+        return;
+    }
+    t_track = millis();
+    if (!track.get(track.now(), &az, &el, &v_az, &v_el)) {
+        return;
+    }
+    if (el < 0) {
+        // Between two passes, the next one starts in the normal geometry
+        // and chooses its turn of the cable wrap
+        flip.reset();
+        wrap.reset();
+    }
+    if (rotator.flip) {
+        // Cross the zenith without the azimuth swing
+        flip.plan(&az, &el, &v_az, &v_el);
+    }
+    // Braking distance v^2 / 2a in mdeg
+    const float two_accel = 2.0 * MDEG_TURN * MAX_ACCELERATION / (SPR * RATIO);
+    az += lround(v_az * fabs(v_az) / two_accel);
+    el += lround(v_el * fabs(v_el) / two_accel);
+    // The trajectory azimuth is unwrapped, the pass keeps one turn of the
+    // cable wrap
+    if (!wrap.started()) {
+        int32_t lo, hi;
+        if (!track.extent(&lo, &hi)) {
+            // The rest of the pass is not known, keep room ahead
+            if (v_az < 0) {
+                lo -= WRAP_AHEAD;
+            } else {
+                hi += WRAP_AHEAD;
+            }
+        }
+        wrap.start(az, lo, hi, control_az.input, control_az.speed);
+    }
+    control_az.setpoint = wrap.map(az, control_az.input, control_az.speed);
+    control_el.setpoint = constrain(el, MIN_M2_ANGLE * 1000L,
+                                    MAX_M2_ANGLE * 1000L);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Move an axis at a constant speed, it accelerates and
+              decelerates with its profile and stops at the soft limit.
+              At zero speed it holds its set point
+    @param    axis
+              The stepper of the axis
+    @param    speed
+              Speed in mdeg/s, negative to decrease the angle
+    @param    setpoint
+              Position to hold at zero speed in mdeg
+    @param    min
+              Minimum angle of the axis in deg
+    @param    max
+              Maximum angle of the axis in deg
+*/
+/**************************************************************************/
+void run_speed(stepper &axis, int32_t speed, int32_t setpoint, int32_t min,
+               int32_t max) {
+    if (speed == 0) {
+        axis.set_speed_limit(0);
+        axis.move_to(mdeg2step(setpoint));
+        return;
+    }
+    speed = constrain(speed, -2 * MDEG_TURN, 2 * MDEG_TURN);
+    int32_t limit = mdeg2speed(speed);
+    axis.set_speed_limit(limit < 0 ? -limit : limit);
+    axis.move_to(mdeg2step((speed > 0 ? max : min) * 1000L));
 }
@@ -0,0 +1,78 @@
+/*!
+* @file sensors.h
+*
+* It is the polling of the I2C sensors, ENABLE_ENCODER. The AS5601 encoders
+* behind the multiplexer and the TC74 are read in turn through the I2C
+* engine of twi.h, without blocking the loop.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef SENSORS_H_
+#define SENSORS_H_
+
+#include "globals.h"
+#include "twi.h"
+#include "tc74.h"
+#include "encoder.h"
+
+#define SENSOR_PERIOD 20   ///< Period of the sensor readings in ms
+#define TC74_ID       0x48 ///< I2C address of the TC74A0
+
+tc74 temp_sensor(TC74_ID);
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the round of sensor readings. Each
+              round queues the azimuth encoder, the elevation encoder and
+              the TC74, the next round takes their readings and queues them
+              again
+*/
+/**************************************************************************/
+class sensor_poll {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the sensors
+    */
+    /**************************************************************************/
+    void init() {
+        encoder_az.init();
+        encoder_el.init();
+        temp_sensor.init();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Take the readings of the last round and start the next one
+                  every SENSOR_PERIOD, called from the loop and the busy
+                  loops of the homing
+    */
+    /**************************************************************************/
+    void poll() {
+        twi.poll();
+        if (encoder_az.busy() || encoder_el.busy() || temp_sensor.busy() ||
+            millis() - _t_round < SENSOR_PERIOD) {
+            return;
+        }
+        _t_round = millis();
+        encoder_az.collect();
+        encoder_el.collect();
+        int8_t temp;
+        if (temp_sensor.get_temp(&temp)) {
+            rotator.inside_temperature = temp;
+        }
+        encoder_az.request();
+        encoder_el.request();
+        temp_sensor.request();
+    }
+
+private:
+    uint32_t _t_round = 0;
+};
+
+sensor_poll sensors;
+
+#endif /* SENSORS_H_ */
@@ -0,0 +1,410 @@
+/*!
+* @file sgp4.h
+*
+* It is a near earth SGP4 propagator, as in Spacetrack Report #3 with the
+* corrections of Vallado et al. 2006, and the look angles of a ground
+* station. It does not depend on Arduino, so the same code runs on the host.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef SGP4_H_
+#define SGP4_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#define SGP4_RE     6378.135     ///< Earth radius in km, WGS-72
+#define SGP4_XKE    0.0743669161 ///< sqrt(mu) in earth radii^1.5/min, WGS-72
+#define SGP4_J2     0.001082616  ///< Second zonal harmonic, WGS-72
+#define SGP4_J3OJ2  -0.00234506  ///< J3/J2, WGS-72
+#define SGP4_J4     -0.00000165597 ///< Fourth zonal harmonic, WGS-72
+#define SGP4_TWO_PI 6.283185307179586 ///< 2 pi
+#define SGP4_DEG    0.017453292519943295 ///< Radians per degree
+
+/** Errors of the propagator, numbered as in Vallado et al. */
+enum _sgp4_error {
+    sgp4_no_error = 0, sgp4_eccentricity = 1, sgp4_mean_motion = 2,
+    sgp4_semi_latus = 4, sgp4_decayed = 6, sgp4_deep_space = 7
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the SGP4 propagation of a near earth
+              satellite, period less than 225 min. The precision is set by
+              the template type, float on the AVR. Only the position is
+              computed, the velocity is not needed for pointing
+*/
+/**************************************************************************/
+template <typename real>
+class sgp4 {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the propagator from the mean elements of a TLE
+        @param    bstar
+                  Drag term in 1/earth radii
+        @param    ecco
+                  Eccentricity
+        @param    argpo
+                  Argument of perigee in rad
+        @param    inclo
+                  Inclination in rad
+        @param    mo
+                  Mean anomaly in rad
+        @param    no_kozai
+                  Mean motion in rad/min
+        @param    nodeo
+                  Right ascension of ascending node in rad
+        @return   _sgp4_error
+    */
+    /**************************************************************************/
+    enum _sgp4_error init(real bstar, real ecco, real argpo, real inclo,
+                          real mo, real no_kozai, real nodeo) {
+        const real x2o3 = 2.0 / 3.0;
+        _bstar = bstar;
+        _ecco = ecco;
+        _argpo = argpo;
+        _inclo = inclo;
+        _mo = mo;
+        _nodeo = nodeo;
+        if (ecco < 0 || ecco >= 1) {
+            return sgp4_eccentricity;
+        }
+        if (no_kozai <= 0) {
+            return sgp4_mean_motion;
+        }
+
+        // Recover the original mean motion and semi major axis
+        real eccsq = ecco * ecco;
+        real omeosq = 1 - eccsq;
+        real rteosq = sqrt(omeosq);
+        _cosio = cos(inclo);
+        real cosio2 = _cosio * _cosio;
+        real ak = pow(SGP4_XKE / no_kozai, x2o3);
+        real d1 = 0.75 * SGP4_J2 * (3 * cosio2 - 1) / (rteosq * omeosq);
+        real del = d1 / (ak * ak);
+        real adel = ak * (1 - del * del - del *
+                          (1.0 / 3.0 + 134 * del * del / 81));
+        del = d1 / (adel * adel);
+        _no = no_kozai / (1 + del);
+        if (SGP4_TWO_PI / _no >= 225) {
+            return sgp4_deep_space;
+        }
+        real ao = pow(SGP4_XKE / _no, x2o3);
+        _sinio = sin(inclo);
+        real po = ao * omeosq;
+        real con42 = 1 - 5 * cosio2;
+        _con41 = -con42 - cosio2 - cosio2;
+        real posq = po * po;
+        real rp = ao * (1 - ecco);
+
+        // Simplified drag model below 220 km perigee
+        _isimp = rp < 220 / SGP4_RE + 1;
+        real sfour = 78 / SGP4_RE + 1;
+        real qzms24 = pow((120 - 78) / SGP4_RE, 4);
+        real perige = (rp - 1) * SGP4_RE;
+        if (perige < 156) {
+            sfour = perige < 98 ? 20 : perige - 78;
+            qzms24 = pow((120 - sfour) / SGP4_RE, 4);
+            sfour = sfour / SGP4_RE + 1;
+        }
+        real pinvsq = 1 / posq;
+        real tsi = 1 / (ao - sfour);
+        _eta = ao * ecco * tsi;
+        real etasq = _eta * _eta;
+        real eeta = ecco * _eta;
+        real psisq = fabs(1 - etasq);
+        real coef = qzms24 * pow(tsi, 4);
+        real coef1 = coef / pow(psisq, 3.5);
+        real cc2 = coef1 * _no * (ao * (1 + 1.5 * etasq + eeta *
+                   (4 + etasq)) + 0.375 * SGP4_J2 * tsi / psisq * _con41 *
+                   (8 + 3 * etasq * (8 + etasq)));
+        _cc1 = bstar * cc2;
+        real cc3 = 0;
+        if (ecco > 1.0e-4) {
+            cc3 = -2 * coef * tsi * SGP4_J3OJ2 * _no * _sinio / ecco;
+        }
+        _x1mth2 = 1 - cosio2;
+        _cc4 = 2 * _no * coef1 * ao * omeosq * (_eta * (2 + 0.5 * etasq) +
+               ecco * (0.5 + 2 * etasq) - SGP4_J2 * tsi / (ao * psisq) *
+               (-3 * _con41 * (1 - 2 * eeta + etasq * (1.5 - 0.5 * eeta)) +
+               0.75 * _x1mth2 * (2 * etasq - eeta * (1 + etasq)) *
+               cos(2 * argpo)));
+        _cc5 = 2 * coef1 * ao * omeosq * (1 + 2.75 * (etasq + eeta) +
+               eeta * etasq);
+
+        // Secular rates of the gravity field
+        real cosio4 = cosio2 * cosio2;
+        real temp1 = 1.5 * SGP4_J2 * pinvsq * _no;
+        real temp2 = 0.5 * temp1 * SGP4_J2 * pinvsq;
+        real temp3 = -0.46875 * SGP4_J4 * pinvsq * pinvsq * _no;
+        _mdot = _no + 0.5 * temp1 * rteosq * _con41 + 0.0625 * temp2 *
+                rteosq * (13 - 78 * cosio2 + 137 * cosio4);
+        _argpdot = -0.5 * temp1 * con42 + 0.0625 * temp2 *
+                   (7 - 114 * cosio2 + 395 * cosio4) + temp3 *
+                   (3 - 36 * cosio2 + 49 * cosio4);
+        real xhdot1 = -temp1 * _cosio;
+        _nodedot = xhdot1 + (0.5 * temp2 * (4 - 19 * cosio2) + 2 * temp3 *
+                   (3 - 7 * cosio2)) * _cosio;
+        _omgcof = bstar * cc3 * cos(argpo);
+        _xmcof = 0;
+        if (ecco > 1.0e-4) {
+            _xmcof = -x2o3 * coef * bstar / eeta;
+        }
+        _nodecf = 3.5 * omeosq * xhdot1 * _cc1;
+        _t2cof = 1.5 * _cc1;
+        real cosio1 = fabs(_cosio + 1) > 1.5e-12 ? 1 + _cosio : 1.5e-12;
+        _xlcof = -0.25 * SGP4_J3OJ2 * _sinio * (3 + 5 * _cosio) / cosio1;
+        _aycof = -0.5 * SGP4_J3OJ2 * _sinio;
+        real delmo = 1 + _eta * cos(mo);
+        _delmo = delmo * delmo * delmo;
+        _sinmao = sin(mo);
+        _x7thm1 = 7 * cosio2 - 1;
+
+        // Drag terms of higher order
+        if (!_isimp) {
+            real cc1sq = _cc1 * _cc1;
+            _d2 = 4 * ao * tsi * cc1sq;
+            real temp = _d2 * tsi * _cc1 / 3;
+            _d3 = (17 * ao + sfour) * temp;
+            _d4 = 0.5 * temp * ao * tsi * (221 * ao + 31 * sfour) * _cc1;
+            _t3cof = _d2 + 2 * cc1sq;
+            _t4cof = 0.25 * (3 * _d3 + _cc1 * (12 * _d2 + 10 * cc1sq));
+            _t5cof = 0.2 * (3 * _d4 + 12 * _cc1 * _d3 + 6 * _d2 * _d2 +
+                     15 * cc1sq * (2 * _d2 + cc1sq));
+        }
+        return sgp4_no_error;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Propagate the satellite
+        @param    tsince
+                  Time since the epoch of the TLE in min
+        @param    r
+                  Position in km, TEME frame
+        @return   _sgp4_error
+    */
+    /**************************************************************************/
+    enum _sgp4_error propagate(real tsince, real r[3]) {
+        const real x2o3 = 2.0 / 3.0;
+        const real tol = sizeof(real) > 4 ? 1.0e-12 : 1.0e-6;
+
+        // Secular gravity and atmospheric drag
+        real xmdf = _mo + _mdot * tsince;
+        real argpdf = _argpo + _argpdot * tsince;
+        real nodedf = _nodeo + _nodedot * tsince;
+        real argpm = argpdf;
+        real mm = xmdf;
+        real t2 = tsince * tsince;
+        real nodem = nodedf + _nodecf * t2;
+        real tempa = 1 - _cc1 * tsince;
+        real tempe = _bstar * _cc4 * tsince;
+        real templ = _t2cof * t2;
+        if (!_isimp) {
+            real delomg = _omgcof * tsince;
+            real delmtemp = 1 + _eta * cos(xmdf);
+            real delm = _xmcof * (delmtemp * delmtemp * delmtemp - _delmo);
+            real temp = delomg + delm;
+            mm = xmdf + temp;
+            argpm = argpdf - temp;
+            real t3 = t2 * tsince;
+            real t4 = t3 * tsince;
+            tempa = tempa - _d2 * t2 - _d3 * t3 - _d4 * t4;
+            tempe = tempe + _bstar * _cc5 * (sin(mm) - _sinmao);
+            templ = templ + _t3cof * t3 + t4 * (_t4cof + tsince * _t5cof);
+        }
+        real am = pow(SGP4_XKE / _no, x2o3) * tempa * tempa;
+        real em = _ecco - tempe;
+        if (em >= 1 || em < -0.001 || am < 0.95) {
+            return sgp4_eccentricity;
+        }
+        if (em < 1.0e-6) {
+            em = 1.0e-6;
+        }
+        mm = mm + _no * templ;
+        real xlm = mm + argpm + nodem;
+        nodem = fmod(nodem, (real)SGP4_TWO_PI);
+        argpm = fmod(argpm, (real)SGP4_TWO_PI);
+        xlm = fmod(xlm, (real)SGP4_TWO_PI);
+
+        // Long period periodics
+        real axnl = em * cos(argpm);
+        real temp = 1 / (am * (1 - em * em));
+        real aynl = em * sin(argpm) + temp * _aycof;
+        real xl = xlm + temp * _xlcof * axnl;
+
+        // Solve the Kepler equation
+        real u = fmod(xl - nodem, (real)SGP4_TWO_PI);
+        real eo1 = u;
+        real sineo1 = 0, coseo1 = 1;
+        for (uint8_t k = 0; k < 10; k++) {
+            sineo1 = sin(eo1);
+            coseo1 = cos(eo1);
+            real tem5 = (u - aynl * coseo1 + axnl * sineo1 - eo1) /
+                        (1 - coseo1 * axnl - sineo1 * aynl);
+            if (fabs(tem5) >= 0.95) {
+                tem5 = tem5 > 0 ? 0.95 : -0.95;
+            }
+            eo1 = eo1 + tem5;
+            if (fabs(tem5) < tol) {
+                break;
+            }
+        }
+
+        // Short period periodics
+        real ecose = axnl * coseo1 + aynl * sineo1;
+        real esine = axnl * sineo1 - aynl * coseo1;
+        real el2 = axnl * axnl + aynl * aynl;
+        real pl = am * (1 - el2);
+        if (pl < 0) {
+            return sgp4_semi_latus;
+        }
+        real rl = am * (1 - ecose);
+        real betal = sqrt(1 - el2);
+        temp = esine / (1 + betal);
+        real sinu = am / rl * (sineo1 - aynl - axnl * temp);
+        real cosu = am / rl * (coseo1 - axnl + aynl * temp);
+        real su = atan2(sinu, cosu);
+        real sin2u = (cosu + cosu) * sinu;
+        real cos2u = 1 - 2 * sinu * sinu;
+        temp = 1 / pl;
+        real temp1 = 0.5 * SGP4_J2 * temp;
+        real temp2 = temp1 * temp;
+        real mrt = rl * (1 - 1.5 * temp2 * betal * _con41) + 0.5 * temp1 *
+                   _x1mth2 * cos2u;
+        if (mrt < 1) {
+            return sgp4_decayed;
+        }
+        su = su - 0.25 * temp2 * _x7thm1 * sin2u;
+        real xnode = nodem + 1.5 * temp2 * _cosio * sin2u;
+        real xinc = _inclo + 1.5 * temp2 * _cosio * _sinio * cos2u;
+
+        // Orientation vectors
+        real sinsu = sin(su);
+        real cossu = cos(su);
+        real snod = sin(xnode);
+        real cnod = cos(xnode);
+        real sini = sin(xinc);
+        real cosi = cos(xinc);
+        real xmx = -snod * cosi;
+        real xmy = cnod * cosi;
+        mrt = mrt * SGP4_RE;
+        r[0] = mrt * (xmx * sinsu + cnod * cossu);
+        r[1] = mrt * (xmy * sinsu + snod * cossu);
+        r[2] = mrt * sini * sinsu;
+        return sgp4_no_error;
+    }
+
+private:
+    real _bstar, _ecco, _argpo, _inclo, _mo, _nodeo, _no;
+    real _cosio, _sinio, _con41, _x1mth2, _x7thm1, _eta;
+    real _cc1, _cc4, _cc5, _d2, _d3, _d4, _delmo, _sinmao;
+    real _mdot, _argpdot, _nodedot, _omgcof, _xmcof, _nodecf;
+    real _t2cof, _t3cof, _t4cof, _t5cof, _xlcof, _aycof;
+    bool _isimp;
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the look angles of a satellite from
+              a ground station, on the WGS-84 ellipsoid. The earth rotation
+              is the mean sidereal time, UT1 is taken equal to UTC
+*/
+/**************************************************************************/
+template <typename real>
+class observer {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the location of the station
+        @param    lat
+                  Geodetic latitude in deg
+        @param    lon
+                  Longitude in deg, east positive
+        @param    alt
+                  Altitude above the ellipsoid in m
+    */
+    /**************************************************************************/
+    void set(real lat, real lon, real alt) {
+        const real a = 6378.137;
+        const real e2 = 0.00669437999014;
+        _lat = lat;
+        _lon = lon;
+        _alt = alt;
+        _sinlat = sin(lat * SGP4_DEG);
+        _coslat = cos(lat * SGP4_DEG);
+        real n = a / sqrt(1 - e2 * _sinlat * _sinlat);
+        _rho = (n + alt / 1000) * _coslat;
+        _z = (n * (1 - e2) + alt / 1000) * _sinlat;
+    }
+
+    real latitude() { return _lat; }
+    real longitude() { return _lon; }
+    real altitude() { return _alt; }
+
+    /**************************************************************************/
+    /*!
+        @brief    Greenwich mean sidereal time. The whole days are reduced
+                  by 4 years first, so it keeps its precision in float
+        @param    day
+                  Days since 2000-01-01 0h UTC
+        @param    ms
+                  Time of the day in ms
+        @return   Sidereal angle in rad
+    */
+    /**************************************************************************/
+    static real sidereal(int32_t day, uint32_t ms) {
+        // 1461 days turn by 1440.0308021 deg, 4 full turns and a bit
+        int32_t cycles = day / 1461;
+        int32_t rest = day - cycles * 1461;
+        if (rest < 0) {
+            rest += 1461;
+            cycles--;
+        }
+        real deg = 99.967794687 + 0.0308021490 * cycles +
+                   0.98564736629 * rest + 360.98564736629 * (ms / 86400000.0);
+        return fmod(deg, (real)360) * SGP4_DEG;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the look angles of a satellite
+        @param    r
+                  Position of the satellite in km, TEME frame
+        @param    theta
+                  Greenwich sidereal angle in rad
+        @param    az
+                  Azimuth in deg, 0-360
+        @param    el
+                  Elevation in deg
+    */
+    /**************************************************************************/
+    void look(const real r[3], real theta, real *az, real *el) {
+        real lst = theta + _lon * SGP4_DEG;
+        real sinlst = sin(lst);
+        real coslst = cos(lst);
+        real rx = r[0] - _rho * coslst;
+        real ry = r[1] - _rho * sinlst;
+        real rz = r[2] - _z;
+        // Topocentric south, east, zenith
+        real top_s = _sinlat * (coslst * rx + sinlst * ry) - _coslat * rz;
+        real top_e = -sinlst * rx + coslst * ry;
+        real top_z = _coslat * (coslst * rx + sinlst * ry) + _sinlat * rz;
+        *el = atan2(top_z, sqrt(top_s * top_s + top_e * top_e)) / SGP4_DEG;
+        *az = atan2(top_e, -top_s) / SGP4_DEG;
+        if (*az < 0) {
+            *az += 360;
+        }
+    }
+
+private:
+    real _lat = 0, _lon = 0, _alt = 0;
+    real _sinlat = 0, _coslat = 1, _rho = 6378.137, _z = 0;
+};
+
+#endif /* SGP4_H_ */
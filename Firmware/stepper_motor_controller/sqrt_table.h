@@ -0,0 +1,116 @@
+/*!
+* @file sqrt_table.h
+*
+* It is the integer square root of the step interrupt, a lookup in a table
+* that the compiler builds in flash, in place of a loop over the bits.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef SQRT_TABLE_H_
+#define SQRT_TABLE_H_
+
+#include "hal.h"
+
+#define SQRT_TABLE_FIRST 64  ///< First entry, the argument is normalized to 64-256 * 256
+#define SQRT_TABLE_LAST  256 ///< Last entry, for the interpolation of 255
+#define SQRT_TABLE_SCALE 2048 ///< Scale of the entries, sqrt(i) * 2048 fits 16 bits
+
+/**************************************************************************/
+/*!
+    @brief    Integer square root at compile time, by bisection
+    @param    x
+              The argument
+    @param    lo
+              Lowest root
+    @param    hi
+              Highest root
+    @return   The root, rounded down
+*/
+/**************************************************************************/
+constexpr uint32_t sqrt_bisect(uint32_t x, uint32_t lo, uint32_t hi) {
+    return lo >= hi ? lo :
+           ((lo + hi + 1) / 2) * ((lo + hi + 1) / 2) <= x ?
+           sqrt_bisect(x, (lo + hi + 1) / 2, hi) :
+           sqrt_bisect(x, lo, (lo + hi + 1) / 2 - 1);
+}
+
+/** Entry of the table, sqrt(i) in units of 1 / SQRT_TABLE_SCALE */
+constexpr uint16_t sqrt_entry(uint16_t i) {
+    return sqrt_bisect((uint32_t)SQRT_TABLE_SCALE * SQRT_TABLE_SCALE * i, 0,
+                       UINT16_MAX);
+}
+
+/** List of indices, to expand the table from a template */
+template<uint16_t... I> struct sqrt_indices {
+};
+
+template<uint16_t N, uint16_t... I> struct sqrt_make_indices :
+    sqrt_make_indices<N - 1, N - 1, I...> {
+};
+
+template<uint16_t... I> struct sqrt_make_indices<0, I...> {
+    typedef sqrt_indices<I...> type;
+};
+
+template<typename T> struct sqrt_table;
+
+/** Table of sqrt(SQRT_TABLE_FIRST + i), built by the compiler */
+template<uint16_t... I> struct sqrt_table<sqrt_indices<I...> > {
+    static const uint16_t entry[sizeof...(I)];
+};
+
+template<uint16_t... I>
+const uint16_t sqrt_table<sqrt_indices<I...> >::entry[sizeof...(I)] PROGMEM = {
+    sqrt_entry(SQRT_TABLE_FIRST + I)...
+};
+
+typedef sqrt_table<sqrt_make_indices<SQRT_TABLE_LAST - SQRT_TABLE_FIRST + 1>::type>
+    sqrt_lookup;
+
+static_assert(sqrt_entry(SQRT_TABLE_LAST) == 16UL * SQRT_TABLE_SCALE,
+              "The last entry is sqrt(256)");
+
+/**************************************************************************/
+/*!
+    @brief    Integer square root. The argument is shifted by an even number
+              of bits to 2^14-2^16, the table gives the root of its high
+              byte and the low byte interpolates, the error is below 0.01%
+              and 1
+    @param    x
+              The argument
+    @return   The root, rounded to the nearest
+*/
+/**************************************************************************/
+inline uint16_t isqrt(uint32_t x) {
+    if (x == 0) {
+        return 0;
+    }
+    // Half the bits of the shift, the root moves by one bit for two
+    int8_t shift = 0;
+    while (x >= 0x10000UL) {
+        x >>= 2;
+        shift++;
+    }
+    uint16_t n = x;
+    while (n < 0x4000) {
+        n <<= 2;
+        shift--;
+    }
+    uint8_t i = (n >> 8) - SQRT_TABLE_FIRST;
+    uint16_t low = pgm_read_word(&sqrt_lookup::entry[i]);
+    uint16_t high = pgm_read_word(&sqrt_lookup::entry[i + 1]);
+    // The step between two entries is below 128, a 8 x 8 bit multiply
+    uint32_t root = low + (((uint8_t)(high - low) * (uint8_t)n + 128U) >> 8);
+    // The entries are sqrt(n) * 128, scale to the argument
+    int8_t right = 7 - shift;
+    if (right > 0) {
+        root = (root + (1U << (right - 1))) >> right;
+    } else {
+        root <<= -right;
+    }
+    return root > UINT16_MAX ? UINT16_MAX : root;
+}
+
+#endif /* SQRT_TABLE_H_ */
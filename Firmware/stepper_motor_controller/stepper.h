@@ -0,0 +1,846 @@
+/*!
+* @file stepper.h
+*
+* It is a timer interrupt driven step generator for STEP/DIR stepper
+* motor drivers, like A4988 or DRV8825.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef STEPPER_H_
+#define STEPPER_H_
+
+#include "hal.h"
+#include "rotator_pins.h"
+#include "sqrt_table.h"
+
+#ifndef STEP_FREQ
+#define STEP_FREQ  20000 ///< Step timer interrupt frequency in Hz
+#endif
+#define RAMP_FREQ  1000  ///< Velocity profile update frequency in Hz
+#define STEP_PHASE ((uint32_t)STEP_FREQ << 16) ///< Phase of one step
+#define STEP_MAX_SPEED (STEP_FREQ / 2) ///< Maximum step rate, pulse high and low take one tick each
+#define RATIO_ONE  65536UL ///< Profile ratio 1.0, Q16 fixed-point
+#define BACKLASH_SPEED 800 ///< Rate of the backlash take-up steps in steps/s, they start without a ramp, consider the microstep
+
+static_assert(HAL_TIMER_CLOCK % STEP_FREQ == 0,
+              "STEP_FREQ divides the Timer1 clock, e.g. 20000 or 40000");
+static_assert(STEP_FREQ % (2 * RAMP_FREQ) == 0 && STEP_FREQ / RAMP_FREQ < 256,
+              "STEP_FREQ is an even multiple of RAMP_FREQ");
+
+/** State of the latch of an input */
+enum _latch_state {
+    latch_off = 0, latch_armed = 1, latch_done = 2
+};
+
+#if ENABLE_TIMING
+#include "timing.h"
+#endif
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for generating the steps of one axis.
+              The timer interrupt calls tick() at STEP_FREQ, which adds the
+              speed to a phase accumulator and makes a step when it
+              overflows. ramp() is called at RAMP_FREQ and follows a
+              trapezoidal velocity profile to the target, or a jerk limited
+              S-curve profile if a jerk is set. The main loop only hands new
+              targets to the axis. When the axis starts in the other
+              direction, the steps of the backlash of the gear come first at
+              BACKLASH_SPEED and the position does not count them.
+    @param    step_pin
+              Digital output, STEP signal of the driver
+    @param    dir_pin
+              Digital output, DIR signal of the driver
+*/
+/**************************************************************************/
+class stepper {
+public:
+
+    stepper(uint8_t step_pin, uint8_t dir_pin) {
+        _step_pin = step_pin;
+        _dir_pin = dir_pin;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the STEP and DIR pins
+    */
+    /**************************************************************************/
+    void init() {
+        pinMode(_step_pin, OUTPUT);
+        pinMode(_dir_pin, OUTPUT);
+        _step_port = portOutputRegister(digitalPinToPort(_step_pin));
+        _step_mask = digitalPinToBitMask(_step_pin);
+        _dir_port = portOutputRegister(digitalPinToPort(_dir_pin));
+        _dir_mask = digitalPinToBitMask(_dir_pin);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the maximum speed
+        @param    max_speed
+                  Maximum speed in steps/s, up to STEP_MAX_SPEED
+    */
+    /**************************************************************************/
+    void set_max_speed(uint16_t max_speed) {
+        if (max_speed > STEP_MAX_SPEED) {
+            max_speed = STEP_MAX_SPEED;
+        }
+        _base_speed = (uint32_t)max_speed << 16;
+        apply_profile();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the acceleration and deceleration
+        @param    acceleration
+                  Acceleration in steps/s^2
+    */
+    /**************************************************************************/
+    void set_acceleration(uint32_t acceleration) {
+        _base_accel = acceleration;
+        apply_profile();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the jerk limit and select the profile
+        @param    jerk
+                  Jerk in steps/s^3 for a S-curve profile, 0 for a
+                  trapezoidal profile
+    */
+    /**************************************************************************/
+    void set_jerk(uint32_t jerk) {
+        if (jerk != _base_jerk) {
+            _base_jerk = jerk;
+            apply_profile();
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Limit the cruise speed below the maximum speed, for the
+                  velocity mode. A faster axis decelerates to it
+        @param    limit
+                  Speed in steps/s, Q16 fixed-point, 0 for no limit
+    */
+    /**************************************************************************/
+    void set_speed_limit(uint32_t limit) {
+        if (limit != _limit) {
+            _limit = limit;
+            apply_profile();
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Scale the maximum speed and the acceleration, so that this
+                  axis follows the same profile in time as a longer move
+        @param    ratio
+                  Ratio of the profile, Q16 fixed-point, RATIO_ONE is the
+                  full speed and acceleration
+    */
+    /**************************************************************************/
+    void set_ratio(uint32_t ratio) {
+        if (ratio > RATIO_ONE) {
+            ratio = RATIO_ONE;
+        }
+        if (ratio != _ratio) {
+            _ratio = ratio;
+            apply_profile();
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the backlash of the gear, the steps that turn the motor
+                  and not the axis after a reversal
+        @param    steps
+                  Backlash in steps, 0 for none
+    */
+    /**************************************************************************/
+    void set_backlash(uint16_t steps) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _backlash = steps;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the backlash of the gear
+        @return   Backlash in steps
+    */
+    /**************************************************************************/
+    uint16_t backlash() {
+        uint16_t steps;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            steps = _backlash;
+        }
+        return steps;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the target position, the axis accelerates, cruises and
+                  decelerates to it
+        @param    target
+                  Absolute position in steps
+    */
+    /**************************************************************************/
+    void move_to(int32_t target) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _target = target;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the target position
+        @return   Absolute position in steps
+    */
+    /**************************************************************************/
+    int32_t target() {
+        int32_t target;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            target = _target;
+        }
+        return target;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Stop immediately, without deceleration, also in the middle
+                  of the backlash
+    */
+    /**************************************************************************/
+    void halt() {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _speed = 0;
+            _accel = 0;
+            _phase = 0;
+            _takeup = 0;
+            _target = _position;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the current position, the axis is stopped
+        @param    position
+                  Absolute position in steps
+    */
+    /**************************************************************************/
+    void set_position(int32_t position) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _speed = 0;
+            _accel = 0;
+            _phase = 0;
+            _takeup = 0;
+            _position = position;
+            _target = position;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Correct the current position by the steps that the motor
+                  missed, the motion goes on to the same target and makes
+                  them up
+        @param    steps
+                  Steps from the counted to the measured position
+    */
+    /**************************************************************************/
+    void correct(int32_t steps) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _position += steps;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Latch the position when an input reaches a level, e.g. the
+                  edge of an end-stop. The interrupt checks the input at
+                  every tick, so the position is the step count at the edge
+                  and not where the loop sees it
+        @param    pin
+                  Digital input
+        @param    level
+                  Level to latch on, HIGH or LOW
+    */
+    /**************************************************************************/
+    void arm_latch(uint8_t pin, bool level) {
+        uint8_t mask = digitalPinToBitMask(pin);
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _latch_port = portInputRegister(digitalPinToPort(pin));
+            _latch_mask = mask;
+            _latch_level = level ? mask : 0;
+            _latch_state = latch_armed;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Stop to watch the input of the latch
+    */
+    /**************************************************************************/
+    void disarm_latch() {
+        _latch_state = latch_off;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the latched position
+        @param    position
+                  Absolute position in steps at the level of the input
+        @return   True if the input reached the level since arm_latch()
+    */
+    /**************************************************************************/
+    bool latched(int32_t *position) {
+        if (_latch_state != latch_done) {
+            return false;
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            *position = _latch;
+        }
+        return true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the current position
+        @return   Absolute position in steps
+    */
+    /**************************************************************************/
+    int32_t position() {
+        int32_t position;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            position = _position;
+        }
+        return position;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the position where the axis stops if it starts to
+                  brake now, with the deceleration of its profile
+        @return   Absolute position in steps
+    */
+    /**************************************************************************/
+    int32_t stopping_point() {
+        uint32_t speed;
+        int32_t accel, position;
+        int8_t dir;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            speed = _speed;
+            accel = _accel;
+            position = _position;
+            dir = _dir;
+        }
+        if (speed == 0) {
+            return position;
+        }
+        // Braking distance as in can_cruise(), rounded up
+        int32_t distance = 1;
+        if (accel > 0 && _dj != 0) {
+            speed += rise(accel);
+            distance += (speed >> 16) * (accel / _dj) / RAMP_FREQ;
+        }
+        uint32_t v = speed >> 16;
+        distance += (v * v + v * _a2j) / _two_accel;
+        return position + dir * distance;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the current speed
+        @return   Speed in steps/s, Q16 fixed-point, negative when the
+                  position decreases
+    */
+    /**************************************************************************/
+    int32_t speed() {
+        int32_t speed;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            speed = _dir > 0 ? (int32_t)_speed : -(int32_t)_speed;
+        }
+        return speed;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the distance from the current position to the target
+        @return   Distance in steps, positive is clockwise
+    */
+    /**************************************************************************/
+    int32_t distance_to_go() {
+        int32_t distance;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            distance = _target - _position;
+        }
+        return distance;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if the axis is moving or has not reached the target
+        @return   True if it is running
+    */
+    /**************************************************************************/
+    bool is_running() {
+        bool running;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            running = _speed != 0 || _takeup != 0 || _target != _position;
+        }
+        return running;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Step routine, called from the timer interrupt at STEP_FREQ
+        @return   True if a step pulse started
+    */
+    /**************************************************************************/
+    bool tick() {
+        if (_latch_state == latch_armed &&
+            (*_latch_port & _latch_mask) == _latch_level) {
+            // The input shows the position after the previous step
+            _latch = _position;
+            _latch_state = latch_done;
+        }
+        if (_pulse) {
+            // End the step pulse of the previous tick
+            *_step_port &= ~_step_mask;
+            _pulse = false;
+        }
+        if (_takeup != 0) {
+            // The gear takes up the backlash, the axis does not move
+            _phase += (uint32_t)BACKLASH_SPEED << 16;
+            if (_phase >= STEP_PHASE) {
+                _phase -= STEP_PHASE;
+                *_step_port |= _step_mask;
+                _pulse = true;
+                _takeup--;
+            }
+            return _pulse;
+        }
+        if (_speed == 0) {
+            return false;
+        }
+        _phase += _speed;
+        if (_phase >= STEP_PHASE) {
+            _phase -= STEP_PHASE;
+            *_step_port |= _step_mask;
+            _pulse = true;
+            _position += _dir;
+        }
+        return _pulse;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Velocity profile routine, called from the timer interrupt
+                  at RAMP_FREQ. The profile is computed with the interrupts
+                  on, so the next ticks make their steps on time, the
+                  square roots and the divisions of the S-curve take longer
+                  than a tick. Only interrupts run in between, the step
+                  interrupt reads the speed and does not change the profile
+    */
+    /**************************************************************************/
+    void ramp() {
+        if (_takeup != 0) {
+            // The profile starts after the backlash
+            return;
+        }
+        int32_t distance = _target - _position;
+        if (_speed == 0) {
+            if (distance == 0) {
+                return;
+            }
+            // Start from rest, set the direction
+            int8_t dir = distance > 0 ? 1 : -1;
+            if (dir > 0) {
+                *_dir_port |= _dir_mask;
+            } else {
+                *_dir_port &= ~_dir_mask;
+            }
+            if (dir != _dir) {
+                // A reversal, take up the backlash of the gear first
+                _dir = dir;
+                _takeup = _backlash;
+                if (_takeup != 0) {
+                    _phase = 0;
+                    return;
+                }
+            }
+        }
+        if (distance == 0) {
+            // Arrived, the speed is close to zero
+            _speed = 0;
+            _accel = 0;
+            _phase = 0;
+            return;
+        }
+        // Distance in the direction of motion, negative if the target is
+        // behind
+        int32_t to_go = _dir > 0 ? distance : -distance;
+        uint32_t speed;
+        NONATOMIC_BLOCK(NONATOMIC_FORCEOFF) {
+            speed = _dj == 0 ? ramp_trapezoid(to_go) : ramp_s_curve(to_go);
+        }
+        _speed = speed;
+    }
+
+private:
+    uint8_t _step_pin, _dir_pin;
+    volatile uint8_t *_step_port, *_dir_port;
+    uint8_t _step_mask, _dir_mask;
+
+    volatile int32_t _position = 0; ///< Current position in steps
+    volatile int32_t _target = 0;   ///< Target position in steps
+    volatile uint32_t _speed = 0;   ///< Speed in steps/s, Q16 fixed-point
+    int32_t _accel = 0;             ///< Speed change per ramp of S-curve, Q16 fixed-point
+    uint32_t _phase = 0;            ///< Phase accumulator
+    int8_t _dir = 1;                ///< Direction of motion, 1 or -1, also of the last one at rest
+    bool _pulse = false;            ///< Step pin is high
+    uint16_t _backlash = 0;         ///< Backlash of the gear in steps
+    volatile uint16_t _takeup = 0;  ///< Backlash steps left before the profile starts
+
+    volatile uint8_t *_latch_port;  ///< Input register of the latch
+    uint8_t _latch_mask = 0, _latch_level = 0;
+    volatile uint8_t _latch_state = latch_off; ///< _latch_state
+    int32_t _latch = 0;             ///< Latched position in steps
+
+    uint32_t _max_speed = 0;        ///< Maximum speed, Q16 fixed-point
+    uint32_t _dv = 1;               ///< Speed change per ramp, Q16 fixed-point
+    uint32_t _two_accel = 0;        ///< Twice the acceleration in steps/s^2
+    int32_t _far = 0;               ///< Distance that needs no braking check
+    uint32_t _dj = 0;               ///< Change of _accel per ramp, Q16 fixed-point, 0 for trapezoidal
+    uint32_t _a2j = 0;              ///< Acceleration^2 / jerk in steps/s
+    uint32_t _rise = 0;             ///< Speed gained while the acceleration eases out, Q16 fixed-point
+
+    uint32_t _base_speed = 0;       ///< Configured maximum speed, Q16 fixed-point
+    uint32_t _base_accel = 0;       ///< Configured acceleration in steps/s^2
+    uint32_t _base_jerk = 0;        ///< Configured jerk in steps/s^3
+    uint32_t _ratio = RATIO_ONE;    ///< Profile ratio, Q16 fixed-point
+    uint32_t _limit = 0;            ///< Cruise speed limit, Q16 fixed-point, 0 for none
+
+    /**************************************************************************/
+    /*!
+        @brief    Trapezoidal profile, constant acceleration and deceleration
+        @param    to_go
+                  Distance to the target in steps
+        @return   New speed, Q16 fixed-point
+    */
+    /**************************************************************************/
+    uint32_t ramp_trapezoid(int32_t to_go) {
+        uint32_t speed = _speed;
+        if (to_go < 0 || speed > _max_speed || !can_cruise(to_go)) {
+            speed = speed > _dv ? speed - _dv : 0;
+        } else if (speed < _max_speed) {
+            speed += _dv;
+            if (speed > _max_speed) {
+                speed = _max_speed;
+            }
+        }
+        return speed;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    S-curve profile, the acceleration changes by the jerk and
+                  eases out before the maximum speed and before the stop
+        @param    to_go
+                  Distance to the target in steps
+        @return   New speed, Q16 fixed-point
+    */
+    /**************************************************************************/
+    uint32_t ramp_s_curve(int32_t to_go) {
+        int32_t accel_target;
+        if (to_go < 0 || _speed > _max_speed || !can_cruise(to_go)) {
+            accel_target = -(int32_t)limit_accel(_speed);
+        } else {
+            accel_target = limit_accel(_max_speed - _speed);
+        }
+        if (_accel < accel_target) {
+            _accel += _dj;
+            if (_accel > accel_target) {
+                _accel = accel_target;
+            }
+        } else if (_accel > accel_target) {
+            _accel -= _dj;
+            if (_accel < accel_target) {
+                _accel = accel_target;
+            }
+        }
+        int32_t speed = (int32_t)_speed + _accel;
+        if (speed <= 0) {
+            speed = 0;
+            _accel = 0;
+        } else if ((uint32_t)speed >= _max_speed && _accel > 0) {
+            speed = _max_speed;
+            _accel = 0;
+        }
+        return speed;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Largest acceleration that still eases out to zero within a
+                  speed change, a = sqrt(2 * j * dv)
+        @param    room
+                  Speed change left, Q16 fixed-point
+        @return   Acceleration per ramp, Q16 fixed-point
+    */
+    /**************************************************************************/
+    uint32_t limit_accel(uint32_t room) {
+        if (room >= _rise) {
+            return _dv;
+        }
+        room >>= 8;
+        if (room > UINT32_MAX / (2 * _dj)) {
+            return _dv;
+        }
+        uint32_t accel = (uint32_t)isqrt(2 * _dj * room) << 4;
+        return accel < _dv ? accel : _dv;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if the axis can keep its speed, or must brake to stop
+                  at the target. The braking distance is v^2 / 2a for the
+                  trapezoidal profile, the S-curve adds v * a / 2j and the
+                  speed gained while a positive acceleration eases out
+        @param    to_go
+                  Distance to the target in steps
+        @return   True if there is room to keep or raise the speed
+    */
+    /**************************************************************************/
+    bool can_cruise(int32_t to_go) {
+        if (to_go >= _far) {
+            return true;
+        }
+        if (_dj == 0 && _speed < (256UL << 16)) {
+            // Slow, compare with the speed in Q8 to arrive on time
+            uint32_t brake = _two_accel * (uint32_t)to_go;
+            uint32_t v = _speed >> 8;
+            return brake >= 0x10000UL || v * v < (brake << 16);
+        }
+        uint32_t v = _speed;
+        if (_accel > 0) {
+            // The positive acceleration eases out first, at most at the
+            // speed it reaches
+            v = (v + rise(_accel)) >> 16;
+            to_go -= v * (_accel / _dj) / RAMP_FREQ;
+            if (to_go <= 0) {
+                return false;
+            }
+        } else {
+            v >>= 16;
+        }
+        uint32_t brake = _two_accel * (uint32_t)to_go;
+        if (v < _a2j) {
+            // Too slow to reach the full deceleration, the braking distance
+            // is v * sqrt(v / j)
+            return 2 * v * isqrt(v * _a2j) < brake;
+        }
+        return v * v + v * _a2j < brake;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Speed gained while an acceleration eases out to zero,
+                  a^2 / 2j
+        @param    accel
+                  Acceleration per ramp, Q16 fixed-point
+        @return   Speed, Q16 fixed-point
+    */
+    /**************************************************************************/
+    uint32_t rise(uint32_t accel) {
+        if (accel >= _dv) {
+            return _rise;
+        }
+        accel >>= 8;
+        uint32_t square = accel * accel;
+        if (square < 0x1000000UL) {
+            return ((square << 8) / (2 * _dj)) << 8;
+        }
+        return (square / (2 * _dj)) << 16;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Compute the profile parameters used by the interrupt from
+                  the configured speed, acceleration and ratio
+    */
+    /**************************************************************************/
+    void apply_profile() {
+        uint32_t max_speed = scale(_base_speed, _ratio);
+        uint32_t accel = scale(_base_accel, _ratio);
+        if (max_speed < RATIO_ONE) {
+            max_speed = RATIO_ONE;
+        }
+        if (_limit != 0 && max_speed > _limit) {
+            // Below one step/s for the slow objects
+            max_speed = _limit;
+        }
+        if (accel == 0) {
+            accel = 1;
+        }
+        // Speed change per ramp, Q16 fixed-point
+        uint32_t dv = accel < 0x10000UL ? (accel << 16) / RAMP_FREQ :
+                      (accel / RAMP_FREQ) << 16;
+        if (dv == 0) {
+            dv = 1;
+        }
+        // Change of the acceleration per ramp and the terms of the S-curve
+        uint32_t dj = 0, a2j = 0, rise = 0;
+        if (_base_jerk != 0) {
+            uint32_t jerk = scale(_base_jerk, _ratio);
+            if (jerk == 0) {
+                jerk = 1;
+            }
+            dj = jerk < 0x10000UL ?
+                 (jerk << 16) / ((uint32_t)RAMP_FREQ * RAMP_FREQ) :
+                 ((jerk / RAMP_FREQ) << 16) / RAMP_FREQ;
+            if (dj == 0) {
+                dj = 1;
+            }
+            a2j = accel < 0x10000UL ? accel * accel / jerk :
+                  accel / jerk * accel;
+            if (a2j > STEP_MAX_SPEED) {
+                a2j = STEP_MAX_SPEED;
+            }
+            rise = (dv >> 8) * (dv >> 8) / (2 * dj) << 16;
+        }
+        // Braking distance from the maximum speed, beyond it no multiply
+        // is needed
+        uint32_t v = (max_speed + rise) >> 16;
+        int32_t far = (v * v + v * a2j) / (2 * accel) + 1;
+        if (dj != 0) {
+            far += v * (dv / dj) / RAMP_FREQ;
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _max_speed = max_speed;
+            _two_accel = 2 * accel;
+            _dv = dv;
+            _dj = dj;
+            _a2j = a2j;
+            _rise = rise;
+            _far = far;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Multiply a value by a Q16 ratio without 64-bit arithmetic
+    */
+    /**************************************************************************/
+    static uint32_t scale(uint32_t value, uint32_t ratio) {
+        if (ratio >= RATIO_ONE) {
+            return value;
+        } else if (value < 0x10000UL) {
+            return (value * ratio) >> 16;
+        } else if (value < 0x1000000UL) {
+            return ((value >> 8) * ratio) >> 8;
+        }
+        return (value >> 16) * ratio;
+    }
+};
+
+stepper stepper_az(M1IN1, M1IN2);
+stepper stepper_el(M2IN1, M2IN2);
+
+/**************************************************************************/
+/*!
+    @brief    Compute num / den as a Q16 ratio, for num <= den
+*/
+/**************************************************************************/
+uint32_t ratio_q16(uint32_t num, uint32_t den) {
+    while (den > 0xFFFFUL) {
+        num >>= 1;
+        den >>= 1;
+    }
+    return den == 0 ? RATIO_ONE : (num << 16) / den;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Move two axis so that they start and arrive together. The
+              axis with the longer move keeps its full profile and the
+              profile of the other one is scaled by the ratio of the
+              distances. Both targets are set in the same ramp period. The
+              profiles are planned again only when a target changes
+    @param    a
+              First axis
+    @param    target_a
+              Absolute position of first axis in steps
+    @param    b
+              Second axis
+    @param    target_b
+              Absolute position of second axis in steps
+*/
+/**************************************************************************/
+void move_coordinated(stepper &a, int32_t target_a, stepper &b,
+                      int32_t target_b) {
+    if (a.target() == target_a && b.target() == target_b) {
+        return;
+    }
+    int32_t da = target_a - a.position();
+    int32_t db = target_b - b.position();
+    uint32_t dist_a = da < 0 ? -da : da;
+    uint32_t dist_b = db < 0 ? -db : db;
+    if (dist_a >= dist_b) {
+        a.set_ratio(RATIO_ONE);
+        b.set_ratio(ratio_q16(dist_b, dist_a));
+    } else {
+        a.set_ratio(ratio_q16(dist_a, dist_b));
+        b.set_ratio(RATIO_ONE);
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        a.move_to(target_a);
+        b.move_to(target_b);
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief    Start the step timer, it interrupts at STEP_FREQ
+*/
+/**************************************************************************/
+void stepper_timer_init() {
+    hal_timer_init(STEP_FREQ);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Timer1 compare match interrupt routine, makes the steps of both
+              axis and updates their velocity profile. The profiles of the
+              two axis are updated in different ticks, half a ramp apart, so
+              one tick carries at most one of them. The profile runs with the
+              interrupts on, the next ticks nest in it and step on time
+*/
+/**************************************************************************/
+ISR(TIMER1_COMPA_vect) {
+    static uint8_t ramp_count = 0;
+#if ENABLE_TIMING
+    timing.tick();
+    if (stepper_az.tick()) {
+        timing.step(timing_step_az);
+    }
+    if (stepper_el.tick()) {
+        timing.step(timing_step_el);
+    }
+#else
+    stepper_az.tick();
+    stepper_el.tick();
+#endif
+    if (++ramp_count == STEP_FREQ / RAMP_FREQ) {
+        ramp_count = 0;
+        stepper_az.ramp();
+    } else if (ramp_count == STEP_FREQ / RAMP_FREQ / 2) {
+        stepper_el.ramp();
+    }
+}
+
+#endif /* STEPPER_H_ */
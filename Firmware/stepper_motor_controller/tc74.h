@@ -0,0 +1,97 @@
+/*!
+* @file tc74.h
+*
+* It is a driver for a TC74 Temperature sensor.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef TC74_H_
+#define TC74_H_
+
+#include "twi.h"
+
+#define TC74_TEMPERATURE_REGISTER 0x00
+#define TC74_CONFIGURATION_REGISTER 0x01
+#define TC74_STANDBY_COMMAND 0x80
+#define TC74_AWAKE_COMMAND 0x00
+#define TC74_DATA_READY_FLAG 0x40
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for interacting with a TC74 Temperature
+              sensor, the readings are queued to the I2C engine
+    @param    id
+              Set the ID of temperature sensor, 7 bit I2C address, 0x48 for
+              the TC74A0
+*/
+/**************************************************************************/
+class tc74 {
+public:
+    tc74(uint8_t id) {
+        _id = id;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the I2C bus
+    */
+    /**************************************************************************/
+    void init() {
+        twi.init();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Queue the reading of the temperature register
+        @return   False if it could not be queued
+    */
+    /**************************************************************************/
+    bool request() {
+        static const uint8_t reg = TC74_TEMPERATURE_REGISTER;
+        if (busy()) {
+            return false;
+        }
+        _transfer.addr = _id;
+        _transfer.tx = &reg;
+        _transfer.tx_len = 1;
+        _transfer.rx = (uint8_t *)&_temp;
+        _transfer.rx_len = 1;
+        return twi.submit(_transfer);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if the reading is still queued
+        @return   True if queued
+    */
+    /**************************************************************************/
+    bool busy() {
+        return _transfer.state == twi_queued;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the temperature of the finished reading
+        @param    temp
+                  The temperature in deg C, it is kept if the reading failed
+        @return   True if the reading is done
+    */
+    /**************************************************************************/
+    bool get_temp(int8_t *temp) {
+        if (_transfer.state != twi_done) {
+            return false;
+        }
+        _transfer.state = twi_idle;
+        *temp = _temp;
+        return true;
+    }
+
+private:
+    uint8_t _id;
+    int8_t _temp = 0;
+    twi_transfer _transfer = { };
+};
+
+#endif /* TC74_H_ */
@@ -0,0 +1,198 @@
+/*!
+* @file timing.h
+*
+* It is the timing instrumentation of the firmware, ENABLE_TIMING. It keeps
+* histograms of the loop() period, of the interval between the step pulses
+* of each axis and of the latency of the step interrupt, with the Timer1 as
+* the time base.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef TIMING_H_
+#define TIMING_H_
+
+#include "hal.h"
+
+#define TIMING_BUCKETS 18 ///< Buckets of a histogram, the last one is open
+#define TIMING_COUNT   4  ///< Number of histograms
+#define TIMING_TICK    (HAL_TIMER_CLOCK / STEP_FREQ) ///< Counts of the Timer1 per tick
+
+/** Histograms of the timing */
+enum _timing_histogram {
+    timing_loop = 0,    ///< Period of loop()
+    timing_step_az = 1, ///< Interval between the step pulses of azimuth
+    timing_step_el = 2, ///< Interval between the step pulses of elevation
+    timing_latency = 3  ///< Delay of the step interrupt after the compare match
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the timing histograms. The time is in
+              counts of the Timer1, 0.5 us, a free-running 32 bit time is
+              the counts of the ticks plus TCNT1. The buckets grow by a
+              power of 2, bucket 0 holds 0 and bucket k from 2^(k-1) to
+              2^k - 1 counts. The counts of a bucket stop at 65535
+*/
+/**************************************************************************/
+class timing_stats {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Step interrupt routine, called first in the interrupt, it
+                  advances the time and records the latency
+    */
+    /**************************************************************************/
+    void tick() {
+        add(timing_latency, hal_timer_count());
+        _base += TIMING_TICK;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Record a step pulse, called from the step interrupt
+        @param    h
+                  timing_step_az or timing_step_el
+    */
+    /**************************************************************************/
+    void step(uint8_t h) {
+        uint32_t now = _base + hal_timer_count();
+        add(h, now - _last[h]);
+        _last[h] = now;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Record the start of a loop()
+    */
+    /**************************************************************************/
+    void loop() {
+        uint32_t now;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            now = _base;
+            uint16_t count = hal_timer_count();
+            // The counter wrapped and the interrupt waits for the block
+            if (hal_timer_pending() && count < TIMING_TICK / 2) {
+                now += TIMING_TICK;
+            }
+            now += count;
+        }
+        if (_started) {
+            add(timing_loop, now - _last[timing_loop]);
+        }
+        _last[timing_loop] = now;
+        _started = true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the samples of a bucket
+        @param    h
+                  Histogram
+        @param    bucket
+                  Bucket, 0 to TIMING_BUCKETS - 1
+        @return   Samples
+    */
+    /**************************************************************************/
+    uint16_t get(uint8_t h, uint8_t bucket) {
+        uint16_t count;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            count = _count[h][bucket];
+        }
+        return count;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Take samples out of a bucket, once they are sent, so the
+                  samples of a dump are not lost or counted twice
+        @param    h
+                  Histogram
+        @param    bucket
+                  Bucket, 0 to TIMING_BUCKETS - 1
+        @param    count
+                  Samples to take, from get()
+    */
+    /**************************************************************************/
+    void take(uint8_t h, uint8_t bucket, uint16_t count) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _count[h][bucket] -= count;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the longest sample of a histogram
+        @param    h
+                  Histogram
+        @return   Time in counts
+    */
+    /**************************************************************************/
+    uint32_t longest(uint8_t h) {
+        uint32_t t;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            t = _max[h];
+        }
+        return t;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Reset the longest sample of a histogram, once it is sent
+        @param    h
+                  Histogram
+    */
+    /**************************************************************************/
+    void reset_longest(uint8_t h) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            _max[h] = 0;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the lowest time of a bucket
+        @param    bucket
+                  Bucket, 0 to TIMING_BUCKETS - 1
+        @return   Time in counts
+    */
+    /**************************************************************************/
+    static uint32_t lower(uint8_t bucket) {
+        return bucket == 0 ? 0 : 1UL << (bucket - 1);
+    }
+
+private:
+    uint16_t _count[TIMING_COUNT][TIMING_BUCKETS] = { };
+    uint32_t _max[TIMING_COUNT] = { };
+    uint32_t _last[TIMING_COUNT] = { }; ///< Time of the last sample, latency unused
+    volatile uint32_t _base = 0;        ///< Time of the last tick
+    bool _started = false;
+
+    /**************************************************************************/
+    /*!
+        @brief    Add a sample to a histogram
+        @param    h
+                  Histogram
+        @param    t
+                  Time in counts
+    */
+    /**************************************************************************/
+    void add(uint8_t h, uint32_t t) {
+        uint8_t bucket = 0;
+        for (uint32_t v = t; v != 0 && bucket < TIMING_BUCKETS - 1; v >>= 1) {
+            bucket++;
+        }
+        if (_count[h][bucket] != 0xFFFF) {
+            _count[h][bucket]++;
+        }
+        if (t > _max[h]) {
+            _max[h] = t;
+        }
+    }
+};
+
+timing_stats timing;
+
+#endif /* TIMING_H_ */
@@ -0,0 +1,267 @@
+/*!
+* @file trajectory.h
+*
+* It is a queue of timestamped az/el samples, streamed by the client,
+* with cubic Hermite interpolation between them.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef TRAJECTORY_H_
+#define TRAJECTORY_H_
+
+#include "hal.h"
+
+#define TRAJ_SIZE 8 ///< Number of samples in the queue
+
+/** Trajectory sample */
+struct _sample {
+    uint32_t t; ///< Time in ms, client time base
+    int32_t az; ///< Azimuth in mdeg, unwrapped
+    int32_t el; ///< Elevation in mdeg
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for a streamed trajectory. The client
+              sets its clock with sync() and sends samples ahead of time,
+              the position and the velocity between the samples are
+              interpolated with a cubic Hermite spline, with Catmull-Rom
+              tangents.
+*/
+/**************************************************************************/
+class trajectory {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the client time base
+        @param    client_ms
+                  Current time of the client in ms
+    */
+    /**************************************************************************/
+    void sync(uint32_t client_ms) {
+        _offset = client_ms - millis();
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the current time in the client time base
+        @return   Time in ms
+    */
+    /**************************************************************************/
+    uint32_t now() {
+        return millis() + _offset;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Append a sample to the queue
+        @param    t
+                  Time of the sample in ms, client time base
+        @param    az
+                  Azimuth in mdeg
+        @param    el
+                  Elevation in mdeg
+        @return   False if the queue is full or the sample is not later
+                  than the last one
+    */
+    /**************************************************************************/
+    bool add(uint32_t t, int32_t az, int32_t el) {
+        if (_count == TRAJ_SIZE) {
+            return false;
+        }
+        if (_count > 0) {
+            const _sample &last = at(_count - 1);
+            if ((int32_t)(t - last.t) <= 0) {
+                return false;
+            }
+            // Unwrap the azimuth, take the shortest way from the last
+            // sample
+            while (az - last.az > 180000L) {
+                az -= 360000L;
+            }
+            while (az - last.az < -180000L) {
+                az += 360000L;
+            }
+        }
+        _sample &s = _samples[(_head + _count) % TRAJ_SIZE];
+        s.t = t;
+        s.az = az;
+        s.el = el;
+        _count++;
+        return true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Remove all samples
+    */
+    /**************************************************************************/
+    void clear() {
+        _head = 0;
+        _count = 0;
+        _known = false;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the azimuth extent of the whole pass, when its source
+                  knows it ahead of the queue. Clear forgets it
+        @param    lo
+                  Lowest azimuth in mdeg, same turn as the first sample
+        @param    hi
+                  Highest azimuth in mdeg, same turn as the first sample
+    */
+    /**************************************************************************/
+    void set_extent(int32_t lo, int32_t hi) {
+        _lo = lo;
+        _hi = hi;
+        _known = true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the azimuth extent of the pass
+        @param    lo
+                  Lowest azimuth in mdeg
+        @param    hi
+                  Highest azimuth in mdeg
+        @return   True if it is the extent of the whole pass, false if it
+                  is the extent of the queue
+    */
+    /**************************************************************************/
+    bool extent(int32_t *lo, int32_t *hi) {
+        if (_known) {
+            *lo = _lo;
+            *hi = _hi;
+            return true;
+        }
+        *lo = *hi = _count > 0 ? at(0).az : 0;
+        for (uint8_t i = 1; i < _count; i++) {
+            *lo = min(*lo, at(i).az);
+            *hi = max(*hi, at(i).az);
+        }
+        return false;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Number of free places in the queue
+        @return   Free places
+    */
+    /**************************************************************************/
+    uint8_t free() {
+        return TRAJ_SIZE - _count;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Interpolate the trajectory. The samples before the current
+                  segment are removed, except one that gives the tangent.
+                  Before the first sample and after the last one, the
+                  position of that sample is held
+        @param    t
+                  Time in ms, client time base
+        @param    az
+                  Azimuth in mdeg, unwrapped
+        @param    el
+                  Elevation in mdeg
+        @param    v_az
+                  Azimuth speed in mdeg/s
+        @param    v_el
+                  Elevation speed in mdeg/s
+        @return   False if the queue is empty
+    */
+    /**************************************************************************/
+    bool get(uint32_t t, int32_t *az, int32_t *el, float *v_az,
+             float *v_el) {
+        if (_count == 0) {
+            return false;
+        }
+        // Find the segment k, k + 1 that contains t
+        uint8_t k = 0;
+        while (k + 1 < _count && (int32_t)(t - at(k + 1).t) >= 0) {
+            k++;
+        }
+        while (k > 1) {
+            _head = (_head + 1) % TRAJ_SIZE;
+            _count--;
+            k--;
+        }
+        const _sample &p1 = at(k);
+        if (k + 1 == _count || (int32_t)(t - p1.t) < 0) {
+            // Hold the position before the start or after the end
+            *az = p1.az;
+            *el = p1.el;
+            *v_az = 0;
+            *v_el = 0;
+            return true;
+        }
+        const _sample &p2 = at(k + 1);
+        const _sample &p0 = k > 0 ? at(k - 1) : p1;
+        const _sample &p3 = k + 2 < _count ? at(k + 2) : p2;
+        // Segment length in s and normalized time
+        float h = (p2.t - p1.t) * 0.001;
+        float s = (t - p1.t) * 0.001 / h;
+        // Tangents, scaled by the segment length
+        float f1 = h / ((p2.t - p0.t) * 0.001);
+        float f2 = h / ((p3.t - p1.t) * 0.001);
+        // Relative to p1, so the float keeps the mdeg of large angles
+        float p;
+        hermite(s, p0.az - p1.az, 0, p2.az - p1.az, p3.az - p1.az, f1, f2, h,
+                &p, v_az);
+        *az = p1.az + lround(p);
+        hermite(s, p0.el - p1.el, 0, p2.el - p1.el, p3.el - p1.el, f1, f2, h,
+                &p, v_el);
+        *el = p1.el + lround(p);
+        return true;
+    }
+
+private:
+    _sample _samples[TRAJ_SIZE];
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    uint32_t _offset = 0;
+    int32_t _lo, _hi;
+    bool _known = false;
+
+    const _sample &at(uint8_t i) {
+        return _samples[(_head + i) % TRAJ_SIZE];
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Evaluate a cubic Hermite segment between p1 and p2
+        @param    s
+                  Normalized time in the segment, 0-1
+        @param    p0, p1, p2, p3
+                  Previous, start, end and next values
+        @param    f1, f2
+                  Tangent scale at start and end, segment length divided
+                  by the length of the two neighbour segments
+        @param    h
+                  Segment length in s
+        @param    p
+                  Interpolated value
+        @param    v
+                  Derivative of the value per s
+    */
+    /**************************************************************************/
+    static void hermite(float s, float p0, float p1, float p2, float p3,
+                        float f1, float f2, float h, float *p, float *v) {
+        float m1 = (p2 - p0) * f1;
+        float m2 = (p3 - p1) * f2;
+        float s2 = s * s;
+        float s3 = s2 * s;
+        *p = (2 * s3 - 3 * s2 + 1) * p1 + (s3 - 2 * s2 + s) * m1 +
+             (-2 * s3 + 3 * s2) * p2 + (s3 - s2) * m2;
+        *v = ((6 * s2 - 6 * s) * (p1 - p2) + (3 * s2 - 4 * s + 1) * m1 +
+              (3 * s2 - 2 * s) * m2) / h;
+    }
+};
+
+trajectory track;
+
+#endif /* TRAJECTORY_H_ */
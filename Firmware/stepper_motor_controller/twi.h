@@ -0,0 +1,231 @@
+/*!
+* @file twi.h
+*
+* It is an interrupt driven I2C master on the TWI. The sensors queue their
+* transfers and the TWI interrupt runs them one after the other, so a
+* reading never blocks the loop.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef TWI_H_
+#define TWI_H_
+
+#include "hal.h"
+
+#define TWI_FREQ    400000 ///< Clock of the I2C bus in Hz
+#define TWI_QUEUE   8      ///< Size of the transfer queue, power of 2
+#define TWI_TIMEOUT 5      ///< Time without progress before the bus is recovered in ms
+
+/** State of a transfer */
+enum _twi_state {
+    twi_idle = 0, twi_queued = 1, twi_done = 2, twi_failed = 3
+};
+
+/** A transfer, a write, a read or a write and a read after a repeated
+ *  start, e.g. the register address and then the registers */
+struct twi_transfer {
+    uint8_t addr;                    ///< 7 bit address of the device
+    const uint8_t *tx;               ///< Bytes to write
+    uint8_t tx_len;                  ///< Number of bytes to write
+    uint8_t *rx;                     ///< Bytes read
+    uint8_t rx_len;                  ///< Number of bytes to read
+    void (*done)(twi_transfer &t);   ///< Called from the interrupt at the end, may be NULL
+    void *arg;                       ///< Argument for done
+    volatile uint8_t state;          ///< _twi_state
+};
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the I2C transfers. The transfers wait
+              in a queue, the interrupt of each bus event starts the next
+              byte, and the next transfer follows with a stop and a start.
+              The owner of a transfer polls its state or gets the done
+              callback. A slave that holds the bus stops the progress, then
+              poll() fails the queued transfers and frees the bus
+*/
+/**************************************************************************/
+class twi_engine {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the TWI, once for all the devices
+    */
+    /**************************************************************************/
+    void init() {
+        if (!_init) {
+            hal_twi_init(TWI_FREQ);
+            _init = true;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Queue a transfer
+        @param    t
+                  The transfer, it stays in place until it is done
+        @return   False if the queue is full or the transfer is queued
+    */
+    /**************************************************************************/
+    bool submit(twi_transfer &t) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            uint8_t tail = (_tail + 1) & (TWI_QUEUE - 1);
+            if (tail == _head || t.state == twi_queued) {
+                return false;
+            }
+            t.state = twi_queued;
+            _queue[_tail] = &t;
+            _tail = tail;
+            if (!_running) {
+                _running = true;
+                hal_twi_start();
+            }
+        }
+        return true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Watch the progress of the bus, called from the loop. When
+                  a transfer hangs for TWI_TIMEOUT, the queued transfers
+                  fail and the bus is recovered
+    */
+    /**************************************************************************/
+    void poll() {
+        uint8_t progress = _progress;
+        bool running = _running;
+        if (!running || progress != _seen) {
+            _seen = progress;
+            _since = millis();
+            return;
+        }
+        if (millis() - _since < TWI_TIMEOUT) {
+            return;
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            while (_head != _tail) {
+                _queue[_head]->state = twi_failed;
+                _head = (_head + 1) & (TWI_QUEUE - 1);
+            }
+            _running = false;
+        }
+        hal_twi_recover();
+        _recoveries++;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the number of recoveries of a hung bus
+        @return   Recoveries since the start
+    */
+    /**************************************************************************/
+    uint16_t recoveries() {
+        return _recoveries;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    TWI interrupt routine, a bus event ended
+    */
+    /**************************************************************************/
+    void isr() {
+        _progress++;
+        if (_head == _tail) {
+            // The transfers failed in poll() meanwhile
+            hal_twi_stop();
+            return;
+        }
+        twi_transfer &t = *_queue[_head];
+        switch (hal_twi_status()) {
+        case TW_START:
+            _index = 0;
+            _reading = t.tx_len == 0;
+            hal_twi_send(t.addr << 1 | (_reading ? TW_READ : TW_WRITE));
+            break;
+        case TW_REP_START:
+            _index = 0;
+            _reading = true;
+            hal_twi_send(t.addr << 1 | TW_READ);
+            break;
+        case TW_MT_SLA_ACK:
+        case TW_MT_DATA_ACK:
+            if (_index < t.tx_len) {
+                hal_twi_send(t.tx[_index++]);
+            } else if (t.rx_len > 0) {
+                hal_twi_start();
+            } else {
+                finish(t, twi_done);
+            }
+            break;
+        case TW_MR_DATA_ACK:
+            t.rx[_index++] = hal_twi_data();
+            // fall through
+        case TW_MR_SLA_ACK:
+            // Acknowledge all bytes but the last one
+            hal_twi_receive(_index + 1 < t.rx_len);
+            break;
+        case TW_MR_DATA_NACK:
+            t.rx[_index++] = hal_twi_data();
+            finish(t, twi_done);
+            break;
+        case TW_MT_ARB_LOST:
+            // Another master took the bus, start again when it is free
+            hal_twi_start();
+            break;
+        default:
+            // Not acknowledged or bus error
+            finish(t, twi_failed);
+            break;
+        }
+    }
+
+private:
+    twi_transfer *_queue[TWI_QUEUE];
+    volatile uint8_t _head = 0, _tail = 0;
+    volatile bool _running = false;
+    volatile uint8_t _progress = 0; ///< Count of the bus events
+    uint8_t _index = 0;             ///< Next byte of the transfer
+    bool _reading = false;
+    bool _init = false;
+    uint8_t _seen = 0;
+    uint32_t _since = 0;
+    uint16_t _recoveries = 0;
+
+    /**************************************************************************/
+    /*!
+        @brief    End the transfer at the head and start the next one
+        @param    t
+                  The transfer at the head
+        @param    state
+                  twi_done or twi_failed
+    */
+    /**************************************************************************/
+    void finish(twi_transfer &t, uint8_t state) {
+        t.state = state;
+        if (t.done != NULL) {
+            t.done(t);
+        }
+        _head = (_head + 1) & (TWI_QUEUE - 1);
+        if (_head != _tail) {
+            hal_twi_stop_start();
+        } else {
+            hal_twi_stop();
+            _running = false;
+        }
+    }
+};
+
+twi_engine twi;
+
+/**************************************************************************/
+/*!
+    @brief    TWI interrupt routine
+*/
+/**************************************************************************/
+ISR(TWI_vect) {
+    twi.isr();
+}
+
+#endif /* TWI_H_ */
@@ -0,0 +1,240 @@
+/*!
+* @file uart.h
+*
+* It is an interrupt driven driver for the USART0 with RX and TX ring
+* buffers. It replaces the Arduino Serial, no call can block. With
+* ENABLE_RS485 it drives the direction pin of a half-duplex transceiver.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef UART_H_
+#define UART_H_
+
+#include "hal.h"
+
+#define UART_RX_SIZE 64  ///< Size of RX ring buffer, power of 2
+#define UART_TX_SIZE 128 ///< Size of TX ring buffer, power of 2
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for interacting with the USART0. The
+              receive interrupt fills the RX ring and the data register
+              empty interrupt drains the TX ring.
+*/
+/**************************************************************************/
+class uart {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Initialize the USART0, 8N1
+        @param    baudrate
+                  Set the baudrate
+    */
+    /**************************************************************************/
+    void begin(uint32_t baudrate) {
+        _rx_head = _rx_tail = 0;
+        _tx_head = _tx_tail = 0;
+        hal_uart_init(baudrate);
+#if ENABLE_RS485
+        if (_dir_mask != 0) {
+            hal_uart_txc();
+        }
+#endif
+    }
+
+#if ENABLE_RS485
+    /**************************************************************************/
+    /*!
+        @brief    Drive the direction pin of a RS485 transceiver, high while
+                  the UART sends. The transmit complete interrupt releases
+                  the bus right after the stop bit of the last byte, there
+                  is no fixed delay
+        @param    pin
+                  The arduino pin
+    */
+    /**************************************************************************/
+    void direction(uint8_t pin) {
+        pinMode(pin, OUTPUT);
+        digitalWrite(pin, LOW);
+        _dir_port = portOutputRegister(digitalPinToPort(pin));
+        _dir_mask = digitalPinToBitMask(pin);
+        hal_uart_txc();
+    }
+#endif
+
+    /**************************************************************************/
+    /*!
+        @brief    The number of bytes that are available in the RX ring
+        @return   Number of bytes
+    */
+    /**************************************************************************/
+    uint8_t available() {
+        return (_rx_head - _rx_tail) & (UART_RX_SIZE - 1);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Read a byte from the RX ring
+        @return   The byte, or -1 if the ring is empty
+    */
+    /**************************************************************************/
+    int16_t read() {
+        if (_rx_head == _rx_tail) {
+            return -1;
+        }
+        uint8_t c = _rx_buffer[_rx_tail];
+        _rx_tail = (_rx_tail + 1) & (UART_RX_SIZE - 1);
+        return c;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    The free space in the TX ring
+        @return   Number of bytes
+    */
+    /**************************************************************************/
+    uint8_t tx_free() {
+        return (_tx_tail - _tx_head - 1) & (UART_TX_SIZE - 1);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Queue bytes for transmission. The bytes are queued all
+                  together or not at all, it never waits for the UART
+        @param    data
+                  The bytes to transmit
+        @param    len
+                  Number of bytes
+        @return   True if the bytes are queued, false if there is no room
+    */
+    /**************************************************************************/
+    bool write(const uint8_t *data, uint8_t len) {
+        if (len > tx_free()) {
+            return false;
+        }
+        uint8_t head = _tx_head;
+        for (uint8_t i = 0; i < len; i++) {
+            _tx_buffer[head] = data[i];
+            head = (head + 1) & (UART_TX_SIZE - 1);
+        }
+        _tx_head = head;
+#if ENABLE_RS485
+        // Take the bus before the first byte, the port is shared with the
+        // step interrupt
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            *_dir_port |= _dir_mask;
+        }
+#endif
+        // Data register empty interrupt drains the ring
+        hal_uart_tx(true);
+        return true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if all queued bytes have been moved to the UART
+        @return   True if the TX ring is empty
+    */
+    /**************************************************************************/
+    bool tx_empty() {
+        return _tx_head == _tx_tail;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Receive complete routine, called from the interrupt. On
+                  the RS485 bus the bytes are dropped while the direction
+                  pin drives it
+    */
+    /**************************************************************************/
+    void rx_isr() {
+        uint8_t c = hal_uart_get();
+#if ENABLE_RS485
+        // The transceiver hears the bytes of this node while it drives the
+        // bus, its reply would parse as a command to it
+        if (*_dir_port & _dir_mask) {
+            return;
+        }
+#endif
+        uint8_t head = (_rx_head + 1) & (UART_RX_SIZE - 1);
+        // Drop the byte if the ring is full
+        if (head != _rx_tail) {
+            _rx_buffer[_rx_head] = c;
+            _rx_head = head;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Data register empty routine, called from the interrupt
+    */
+    /**************************************************************************/
+    void udre_isr() {
+        hal_uart_put(_tx_buffer[_tx_tail]);
+        _tx_tail = (_tx_tail + 1) & (UART_TX_SIZE - 1);
+        if (_tx_tail == _tx_head) {
+            hal_uart_tx(false);
+        }
+    }
+
+#if ENABLE_RS485
+    /**************************************************************************/
+    /*!
+        @brief    Transmit complete routine, called from the interrupt. It
+                  releases the bus, unless bytes were queued meanwhile
+    */
+    /**************************************************************************/
+    void txc_isr() {
+        if (_tx_tail == _tx_head) {
+            *_dir_port &= ~_dir_mask;
+        }
+    }
+#endif
+
+private:
+    uint8_t _rx_buffer[UART_RX_SIZE];
+    uint8_t _tx_buffer[UART_TX_SIZE];
+    volatile uint8_t _rx_head, _rx_tail;
+    volatile uint8_t _tx_head, _tx_tail;
+#if ENABLE_RS485
+    volatile uint8_t *_dir_port = &_dir_none; ///< Output register of the direction pin
+    uint8_t _dir_mask = 0;
+    uint8_t _dir_none = 0;                    ///< Stands for the port before direction()
+#endif
+};
+
+uart uart0;
+
+/**************************************************************************/
+/*!
+    @brief    USART0 receive complete interrupt routine
+*/
+/**************************************************************************/
+ISR(USART_RX_vect) {
+    uart0.rx_isr();
+}
+
+/**************************************************************************/
+/*!
+    @brief    USART0 data register empty interrupt routine
+*/
+/**************************************************************************/
+ISR(USART_UDRE_vect) {
+    uart0.udre_isr();
+}
+
+#if ENABLE_RS485
+/**************************************************************************/
+/*!
+    @brief    USART0 transmit complete interrupt routine
+*/
+/**************************************************************************/
+ISR(USART_TX_vect) {
+    uart0.txc_isr();
+}
+#endif
+
+#endif /* UART_H_ */
@@ -0,0 +1,87 @@
+/*!
+* @file units.h
+*
+* It is the exact conversion between millidegrees and motor steps, in
+* integer math.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef UNITS_H_
+#define UNITS_H_
+
+#include <stdint.h>
+
+#define MDEG_TURN 360000L ///< Millidegrees of a turn
+
+/** Greatest common divisor, to reduce the ratio of steps to mdeg */
+constexpr int32_t gcd(int32_t a, int32_t b) {
+    return b == 0 ? a : gcd(b, a % b);
+}
+/** Steps per STEP_DEN mdeg, exact, 4 / 45 for the default gear box */
+constexpr int32_t STEP_NUM = RATIO * SPR / gcd(RATIO * SPR, MDEG_TURN);
+constexpr int32_t STEP_DEN = MDEG_TURN / gcd(RATIO * SPR, MDEG_TURN);
+static_assert(STEP_NUM < STEP_DEN,
+              "a step must be coarser than a mdeg to convert it back");
+static_assert(STEP_DEN <= INT32_MAX / (2 * MDEG_TURN),
+              "the conversion of two turns must fit in int32_t");
+
+/**************************************************************************/
+/*!
+    @brief    Convert millidegrees to steps according to step/revolution,
+              rotator gear box ratio and microstep, rounded to the nearest
+              step
+    @param    mdeg
+              Millidegrees, up to two turns
+    @return   Steps for stepper motor driver, int32_t
+*/
+/**************************************************************************/
+int32_t mdeg2step(int32_t mdeg) {
+    int32_t x = mdeg * STEP_NUM;
+    return (x + (x < 0 ? -STEP_DEN : STEP_DEN) / 2) / STEP_DEN;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Convert steps to millidegrees according to step/revolution,
+              rotator gear box ratio and microstep, rounded to the nearest
+              mdeg. The result converts back to the same step
+    @param    step
+              Steps in int32_t format, up to two turns
+    @return   Millidegrees, int32_t
+*/
+/**************************************************************************/
+int32_t step2mdeg(int32_t step) {
+    int32_t x = step * STEP_DEN;
+    return (x + (x < 0 ? -STEP_NUM : STEP_NUM) / 2) / STEP_NUM;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Convert a speed in mdeg/s to steps/s, as the step generator
+    @param    speed
+              Speed in mdeg/s, up to two turns/s
+    @return   Speed in steps/s, Q16 fixed-point
+*/
+/**************************************************************************/
+int32_t mdeg2speed(int32_t speed) {
+    int32_t x = speed * STEP_NUM;
+    return (x / STEP_DEN) * 65536L + (x % STEP_DEN) * 65536L / STEP_DEN;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Convert a speed of the step generator to mdeg/s
+    @param    speed
+              Speed in steps/s, Q16 fixed-point
+    @return   Speed in mdeg/s
+*/
+/**************************************************************************/
+int32_t speed2mdeg(int32_t speed) {
+    int32_t x = speed / 256;
+    return (x / STEP_NUM * STEP_DEN + x % STEP_NUM * STEP_DEN / STEP_NUM) /
+           256;
+}
+
+#endif /* UNITS_H_ */
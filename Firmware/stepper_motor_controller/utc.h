@@ -0,0 +1,190 @@
+/*!
+* @file utc.h
+*
+* It is a UTC clock that runs on millis(), set by the client. The sets of
+* the client trim the rate of the resonator, and the clock ends UTC_STALE
+* after the last one.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef UTC_H_
+#define UTC_H_
+
+#include "hal.h"
+
+#define DAY_MS 86400000UL ///< Milliseconds of a day
+#define UTC_STALE    (2 * DAY_MS) ///< Time after the last set when the clock ends in ms, the stored passes need a set each 2 days
+#define UTC_TRIM_MIN 600000UL ///< Shortest time between two sets that trims the rate in ms
+#define UTC_TRIM_MAX 0.01     ///< Largest rate error of the resonator, a larger one is a step of the client clock
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the UTC clock. The dates are days
+              since 2000-01-01 and ms of the day, the client uses the
+              year and day of the year of the TLE epochs, yyddd
+*/
+/**************************************************************************/
+class utc {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the clock
+        @param    yyddd
+                  Year and day of the year, 2000-2056
+        @param    ms
+                  Time of the day in ms
+        @return   False if the date is invalid
+    */
+    /**************************************************************************/
+    bool set(int32_t yyddd, uint32_t ms) {
+        int32_t day;
+        if (!day_number(yyddd, &day) || ms >= DAY_MS) {
+            return false;
+        }
+        uint32_t elapsed = millis() - _sync;
+        if (_valid && elapsed >= UTC_TRIM_MIN) {
+            // The error of the clock since the last set is the rate error
+            float rate = _trim - (float)since(day, ms) / elapsed;
+            if (fabs(rate) <= UTC_TRIM_MAX) {
+                _trim = rate;
+            }
+        }
+        _day = day;
+        _ms = ms;
+        _sync = millis();
+        _valid = true;
+        return true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    End the clock UTC_STALE after the last set, called from the
+                  loop, so the elapsed time never wraps
+    */
+    /**************************************************************************/
+    void loop() {
+        if (_valid && millis() - _sync >= UTC_STALE) {
+            _valid = false;
+        }
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the clock
+        @param    yyddd
+                  Year and day of the year
+        @param    ms
+                  Time of the day in ms
+        @return   False if the clock is not set, or stale
+    */
+    /**************************************************************************/
+    bool get(int32_t *yyddd, uint32_t *ms) {
+        int32_t day;
+        now(0, &day, ms);
+        int16_t yy = 0;
+        for (;;) {
+            int16_t days = (yy % 4 == 0) ? 366 : 365;
+            if (day < days) {
+                break;
+            }
+            day -= days;
+            yy++;
+        }
+        *yyddd = yy * 1000L + day + 1;
+        return _valid;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if the clock is set
+        @return   True if it is set and not stale
+    */
+    /**************************************************************************/
+    bool valid() {
+        return _valid;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the time from now
+        @param    offset
+                  Time from now in ms, may be negative
+        @param    day
+                  Days since 2000-01-01
+        @param    ms
+                  Time of the day in ms
+    */
+    /**************************************************************************/
+    void now(int32_t offset, int32_t *day, uint32_t *ms) {
+        uint32_t elapsed = millis() - _sync;
+        elapsed += lround(elapsed * _trim);
+        int32_t d = _day + elapsed / DAY_MS;
+        int32_t t = _ms + elapsed % DAY_MS + offset;
+        while (t < 0) {
+            t += DAY_MS;
+            d--;
+        }
+        while (t >= (int32_t)DAY_MS) {
+            t -= DAY_MS;
+            d++;
+        }
+        *day = d;
+        *ms = t;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the time since a date, saturated beyond 24 days
+        @param    day
+                  Days since 2000-01-01
+        @param    ms
+                  Time of the day in ms
+        @return   Time in ms, negative before the date
+    */
+    /**************************************************************************/
+    int32_t since(int32_t day, uint32_t ms) {
+        int32_t d;
+        uint32_t t;
+        now(0, &d, &t);
+        if (d - day > 24) {
+            return INT32_MAX;
+        } else if (d - day < -24) {
+            return -INT32_MAX;
+        }
+        return (d - day) * (int32_t)DAY_MS + ((int32_t)t - (int32_t)ms);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Convert a year and day of the year to days since 2000-01-01
+        @param    yyddd
+                  Year and day of the year, 2000-2056
+        @param    day
+                  Days since 2000-01-01
+        @return   False if the date is invalid
+    */
+    /**************************************************************************/
+    static bool day_number(int32_t yyddd, int32_t *day) {
+        int16_t yy = yyddd / 1000;
+        int16_t doy = yyddd % 1000;
+        if (yyddd < 0 || yy > 56 || doy < 1 || doy > 366) {
+            return false;
+        }
+        *day = 365L * yy + (yy + 3) / 4 + doy - 1;
+        return true;
+    }
+
+private:
+    int32_t _day = 0;
+    uint32_t _ms = 0;
+    uint32_t _sync = 0;  ///< millis() at the last set
+    float _trim = 0;     ///< Rate error of millis(), fast if negative
+    bool _valid = false;
+};
+
+utc utc_clock;
+
+#endif /* UTC_H_ */
@@ -0,0 +1,213 @@
+/*!
+* @file wrap.h
+*
+* It is the planner of the azimuth cable wrap, it chooses the turn of the
+* azimuth within the cable range.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef WRAP_H_
+#define WRAP_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#define WRAP_TURN   360000L ///< Millidegrees of a turn
+#define WRAP_MARGIN 10000L  ///< Room around a pass for the lead and the flip in mdeg
+#define WRAP_AHEAD  180000L ///< Room for the unknown rest of a pass in mdeg
+
+/**************************************************************************/
+/*!
+    @brief    Class that functions for the cable wrap. The azimuth position
+              is the cable position, unwrapped, within a range that may
+              overlap, e.g. -180 to 540 deg. A direction has one position
+              per turn in the range, the planner takes the one that the
+              axis reaches first. A pass keeps one turn from its start to
+              its end, chosen with the extent of the pass, so the axis
+              does not unwind in the middle of a pass
+*/
+/**************************************************************************/
+class cable_wrap {
+public:
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the cable range of the azimuth
+        @param    min
+                  Lowest position in mdeg
+        @param    max
+                  Highest position in mdeg
+    */
+    /**************************************************************************/
+    void set_range(int32_t min, int32_t max) {
+        _min = min;
+        _max = max;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Set the motion limits of the azimuth, for the time of a
+                  move
+        @param    speed
+                  Maximum speed in mdeg/s
+        @param    accel
+                  Acceleration in mdeg/s^2
+    */
+    /**************************************************************************/
+    void set_motion(float speed, float accel) {
+        _speed = speed;
+        _accel = accel;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Get the position of a direction that the axis reaches
+                  first
+        @param    az
+                  Azimuth in mdeg, any turn
+        @param    position
+                  Position of the axis in mdeg
+        @param    speed
+                  Speed of the axis in mdeg/s
+        @return   Position in mdeg, within the range
+    */
+    /**************************************************************************/
+    int32_t shortest(int32_t az, int32_t position, int32_t speed) {
+        return choose(az, az, az, position, speed);
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Choose the turn of a pass
+        @param    az
+                  Azimuth of the start in mdeg, unwrapped
+        @param    lo
+                  Lowest azimuth of the pass in mdeg, same turn as az
+        @param    hi
+                  Highest azimuth of the pass in mdeg, same turn as az
+        @param    position
+                  Position of the axis in mdeg
+        @param    speed
+                  Speed of the axis in mdeg/s
+    */
+    /**************************************************************************/
+    void start(int32_t az, int32_t lo, int32_t hi, int32_t position,
+               int32_t speed) {
+        lo = (lo < az ? lo : az) - WRAP_MARGIN;
+        hi = (hi > az ? hi : az) + WRAP_MARGIN;
+        _offset = choose(az, lo, hi, position, speed) - az;
+        _started = true;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    The pass is over, the next one chooses its turn
+    */
+    /**************************************************************************/
+    void reset() {
+        _started = false;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Check if a pass has its turn
+        @return   True if started
+    */
+    /**************************************************************************/
+    bool started() {
+        return _started;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Map an azimuth of the pass to the cable position. When a
+                  pass leaves the range, e.g. its extent was not known, the
+                  axis unwinds to the position it reaches first
+        @param    az
+                  Azimuth in mdeg, unwrapped
+        @param    position
+                  Position of the axis in mdeg
+        @param    speed
+                  Speed of the axis in mdeg/s
+        @return   Position in mdeg, within the range
+    */
+    /**************************************************************************/
+    int32_t map(int32_t az, int32_t position, int32_t speed) {
+        int32_t p = az + _offset;
+        if (p < _min || p > _max) {
+            p = shortest(az, position, speed);
+            _offset = p - az;
+        }
+        return p;
+    }
+
+private:
+    int32_t _min = 0, _max = WRAP_TURN;
+    float _speed = 1, _accel = 1;
+    int32_t _offset = 0;
+    bool _started = false;
+
+    /**************************************************************************/
+    /*!
+        @brief    Choose the turn that reaches az first and keeps lo to hi in
+                  the range. If no turn keeps it, the one that keeps most
+                  of it
+        @return   Position of az in mdeg
+    */
+    /**************************************************************************/
+    int32_t choose(int32_t az, int32_t lo, int32_t hi, int32_t position,
+                   int32_t speed) {
+        // First turn that keeps lo in the range
+        int32_t k = _min - lo;
+        k = k > 0 ? (k + WRAP_TURN - 1) / WRAP_TURN : -(-k / WRAP_TURN);
+        int32_t best = az + k * WRAP_TURN;
+        float best_time = -1;
+        int32_t best_out = 0;
+        for (int32_t shift = k * WRAP_TURN; lo + shift <= _max;
+             shift += WRAP_TURN) {
+            int32_t out = hi + shift > _max ? hi + shift - _max : 0;
+            float t = time(az + shift - position, speed);
+            if (best_time < 0 || out < best_out ||
+                (out == best_out && t < best_time)) {
+                best = az + shift;
+                best_time = t;
+                best_out = out;
+            }
+        }
+        return best < _min ? _min : best > _max ? _max : best;
+    }
+
+    /**************************************************************************/
+    /*!
+        @brief    Time of a move with the trapezoidal profile
+        @param    distance
+                  Distance in mdeg
+        @param    speed
+                  Speed at the start in mdeg/s
+        @return   Time in s
+    */
+    /**************************************************************************/
+    float time(float distance, float speed) {
+        if (distance < 0) {
+            distance = -distance;
+            speed = -speed;
+        }
+        float t = 0;
+        if (speed < 0 || speed * speed > 2 * _accel * distance) {
+            // Brake first, then start from rest
+            t = fabs(speed) / _accel;
+            distance = fabs(distance - speed * fabs(speed) / (2 * _accel));
+            speed = 0;
+        }
+        float peak = fmin(_speed, sqrt(_accel * distance + speed * speed / 2));
+        float cruise = distance - (2 * peak * peak - speed * speed) /
+                                  (2 * _accel);
+        return t + (2 * peak - speed) / _accel + fmax(cruise, 0) / _speed;
+    }
+};
+
+cable_wrap wrap;
+
+#endif /* WRAP_H_ */
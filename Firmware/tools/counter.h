@@ -0,0 +1,64 @@
+/*!
+* @file counter.h
+*
+* It is a float that counts its operations, to estimate the cost of a
+* computation on a target without FPU.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef COUNTER_H_
+#define COUNTER_H_
+
+#include <math.h>
+
+/** Kinds of counted operations */
+enum _op {
+    op_add, op_mul, op_div, op_cmp, op_sqrt, op_sin, op_atan2, op_pow,
+    op_fmod, op_count
+};
+
+/** Operation counts, shared by all counters */
+extern unsigned long op_counts[op_count];
+
+/**************************************************************************/
+/*!
+    @brief    Class that behaves as a float and counts every arithmetic
+              operation and math function call
+*/
+/**************************************************************************/
+class counter {
+public:
+    counter() : v(0) {}
+    counter(double x) : v(x) {}
+    explicit operator double() const { return v; }
+
+    counter &operator+=(counter b) { op_counts[op_add]++; v += b.v; return *this; }
+    counter &operator-=(counter b) { op_counts[op_add]++; v -= b.v; return *this; }
+    counter &operator*=(counter b) { op_counts[op_mul]++; v *= b.v; return *this; }
+    counter &operator/=(counter b) { op_counts[op_div]++; v /= b.v; return *this; }
+    counter operator-() const { return counter(-v); }
+
+    friend counter operator+(counter a, counter b) { return a += b; }
+    friend counter operator-(counter a, counter b) { return a -= b; }
+    friend counter operator*(counter a, counter b) { return a *= b; }
+    friend counter operator/(counter a, counter b) { return a /= b; }
+    friend bool operator<(counter a, counter b) { op_counts[op_cmp]++; return a.v < b.v; }
+    friend bool operator>(counter a, counter b) { op_counts[op_cmp]++; return a.v > b.v; }
+    friend bool operator<=(counter a, counter b) { op_counts[op_cmp]++; return a.v <= b.v; }
+    friend bool operator>=(counter a, counter b) { op_counts[op_cmp]++; return a.v >= b.v; }
+
+    friend counter sqrt(counter a) { op_counts[op_sqrt]++; return counter(sqrtf(a.v)); }
+    friend counter sin(counter a) { op_counts[op_sin]++; return counter(sinf(a.v)); }
+    friend counter cos(counter a) { op_counts[op_sin]++; return counter(cosf(a.v)); }
+    friend counter fabs(counter a) { return counter(fabsf(a.v)); }
+    friend counter atan2(counter a, counter b) { op_counts[op_atan2]++; return counter(atan2f(a.v, b.v)); }
+    friend counter pow(counter a, counter b) { op_counts[op_pow]++; return counter(powf(a.v, b.v)); }
+    friend counter fmod(counter a, counter b) { op_counts[op_fmod]++; return counter(fmodf(a.v, b.v)); }
+
+private:
+    float v;
+};
+
+#endif /* COUNTER_H_ */
@@ -0,0 +1,192 @@
+/*!
+* @file flip_sim.cpp
+*
+* It is the host simulation of the flip planner. It follows high passes of
+* a satellite in a circular orbit with a rotator that has the speed and
+* acceleration limits of the sketch, in the normal geometry and with the
+* flip planner, and compares their pointing error.
+*
+* Usage: flip_sim [altitude_km=420] [rate_fraction=1]
+*
+* Licensed under the GPLv3
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "flip.h"
+
+/* Motion limits of the sketch */
+#define RATIO            80
+#define SPR              400L
+#define MAX_SPEED        1600
+#define MAX_ACCELERATION 1600
+
+#define EARTH_RADIUS 6371.0   ///< km
+#define EARTH_MU     398600.4 ///< km^3/s^2
+#define TICK         0.001    ///< Step of the rotator model in s
+#define TRACK        0.010    ///< Period of the set points in s, TRACK_PERIOD
+
+static const double deg = M_PI / 180;
+
+/** A pass of a satellite in a circular orbit, without the Earth rotation */
+struct pass_model {
+    double r, n;    ///< Orbit radius in km and angular rate in rad/s
+    double beta;    ///< Central angle of the closest approach in rad
+    double heading; ///< Azimuth of the ground track in rad
+
+    /** Direction from the station, az unwrapped by the caller */
+    void look(double t, double *az, double *el) {
+        double c = cos(n * t), s = sin(n * t);
+        // Orbit through (sin beta, 0, cos beta) r at t = 0, moving along y
+        double x = r * c * sin(beta);
+        double y = r * s;
+        double z = r * c * cos(beta) - EARTH_RADIUS;
+        double e = x * cos(heading) + y * sin(heading);
+        double nn = -x * sin(heading) + y * cos(heading);
+        *az = atan2(e, nn) / deg * 1000;
+        *el = atan2(z, sqrt(e * e + nn * nn)) / deg * 1000;
+    }
+
+    /** Time of the horizon crossing before the closest approach */
+    double rise() {
+        double t = 0, az, el;
+        do {
+            t -= 1;
+            look(t, &az, &el);
+        } while (el > 0);
+        return t;
+    }
+};
+
+/** Axis with a time optimal approach of its set point */
+struct axis_model {
+    double pos, vel; ///< mdeg, mdeg/s
+    double vmax, accel;
+
+    void step(double target) {
+        double err = target - pos;
+        double want = sqrt(2 * accel * fabs(err));
+        want = fmin(want, vmax);
+        want = err < 0 ? -want : want;
+        double dv = accel * TICK;
+        vel += fmax(-dv, fmin(dv, want - vel));
+        pos += vel * TICK;
+    }
+};
+
+/** Angle between two directions in deg, the elevations may exceed 90 */
+static double separation(double az1, double el1, double az2, double el2) {
+    double a1 = az1 / 1000 * deg, e1 = el1 / 1000 * deg;
+    double a2 = az2 / 1000 * deg, e2 = el2 / 1000 * deg;
+    double x = cos(e1) * sin(a1) * cos(e2) * sin(a2) +
+               cos(e1) * cos(a1) * cos(e2) * cos(a2) + sin(e1) * sin(e2);
+    return acos(fmax(-1, fmin(1, x))) / deg;
+}
+
+struct result {
+    double max_error, peak_rate, max_el;
+};
+
+/**************************************************************************/
+/*!
+    @brief    Follow a pass, as follow_trajectory() of the sketch
+*/
+/**************************************************************************/
+static result follow(pass_model &p, bool flipped, double rate) {
+    const double mdeg_step = 360000.0 / (RATIO * SPR);
+    axis_model az_axis = { 0, 0, MAX_SPEED * mdeg_step,
+                           MAX_ACCELERATION * mdeg_step };
+    axis_model el_axis = az_axis;
+    flip.reset();
+    flip.set_rate(rate * az_axis.vmax, (uint16_t)lround(TRACK * 1000));
+    double t0 = p.rise(), t1 = -t0;
+    double az, el, last_az = 0;
+    p.look(t0, &az, &el);
+    az_axis.pos = az;
+    last_az = az;
+    result res = { 0, 0, 0 };
+    double set_az = 0, set_el = 0, prev_set_az = az;
+    const double two_accel = 2 * az_axis.accel;
+    int ticks = (int)lround(TRACK / TICK);
+    int k = 0;
+    for (double t = t0; t <= t1; t += TICK, k++) {
+        p.look(t, &az, &el);
+        // Unwrap as the trajectory queue does
+        while (az - last_az > 180000) {
+            az -= 360000;
+        }
+        while (az - last_az < -180000) {
+            az += 360000;
+        }
+        last_az = az;
+        if (k % ticks == 0) {
+            double az2, el2;
+            p.look(t + TRACK, &az2, &el2);
+            while (az2 - az > 180000) {
+                az2 -= 360000;
+            }
+            while (az2 - az < -180000) {
+                az2 += 360000;
+            }
+            float v_az = (az2 - az) / TRACK, v_el = (el2 - el) / TRACK;
+            int32_t a = lround(az), e = lround(el);
+            if (flipped) {
+                flip.plan(&a, &e, &v_az, &v_el);
+            }
+            set_az = a + v_az * fabs(v_az) / two_accel;
+            set_el = e + v_el * fabs(v_el) / two_accel;
+            set_el = fmax(0, fmin(180000, set_el));
+            res.peak_rate = fmax(res.peak_rate,
+                                 fabs(a - prev_set_az) / TRACK / 1000);
+            prev_set_az = a;
+        }
+        az_axis.step(set_az);
+        el_axis.step(set_el);
+        res.max_el = fmax(res.max_el, el / 1000);
+        if (t > t0 + 30 && t < t1 - 30) {
+            // After the approach to the horizon crossing
+            res.max_error = fmax(res.max_error, separation(
+                az_axis.pos, el_axis.pos, az, el));
+        }
+    }
+    return res;
+}
+
+int main(int argc, char **argv) {
+    double alt = argc > 1 ? atof(argv[1]) : 420;
+    double rate = argc > 2 ? atof(argv[2]) : 1;
+    pass_model p;
+    p.r = EARTH_RADIUS + alt;
+    p.n = sqrt(EARTH_MU / (p.r * p.r * p.r));
+    p.heading = 30 * deg;
+
+    printf("Orbit %.0f km, rotator %.1f deg/s and %.1f deg/s^2, crossing "
+           "above %.0f%% of the speed\n", alt,
+           MAX_SPEED * 360.0 / (RATIO * SPR),
+           MAX_ACCELERATION * 360.0 / (RATIO * SPR), rate * 100);
+    printf("\n max el   peak az rate [deg/s]   max error [deg]\n");
+    printf("  [deg]     normal      flip     normal    flip\n");
+    const double targets[] = { 60, 70, 80, 85, 87, 88, 88.5, 89, 89.5, 89.9 };
+    for (double target : targets) {
+        // Central angle of the closest approach for the maximum elevation
+        double lo = 0, hi = 30 * deg;
+        for (int i = 0; i < 60; i++) {
+            p.beta = (lo + hi) / 2;
+            double az, el;
+            p.look(0, &az, &el);
+            if (el / 1000 > target) {
+                lo = p.beta;
+            } else {
+                hi = p.beta;
+            }
+        }
+        result normal = follow(p, false, rate);
+        result flipped = follow(p, true, rate);
+        printf("  %5.1f   %8.1f  %8.1f   %8.2f  %6.2f\n", normal.max_el,
+               normal.peak_rate, flipped.peak_rate, normal.max_error,
+               flipped.max_error);
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+/*!
+* @file mdeg_bench.cpp
+*
+* It is the host benchmark of the millidegree position path. It checks the
+* integer step conversion against the exact rational one, simulates long
+* tracking sessions with the former float path and with the integer path
+* to compare their drift, and estimates the cost of the conversions of
+* one loop on the ATmega328P.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* Gear box of the sketch */
+#define RATIO 80
+#define SPR   400L
+#include "units.h"
+
+#define TURN_STEPS (RATIO * SPR) ///< Steps of a turn
+
+/** Approximate avr-libc and libgcc cycles of each operation on the AVR */
+enum _cost {
+    float_mul = 150, float_div = 480, int_to_float = 70, float_to_int = 70,
+    long_mul = 60, long_div = 650, long_shift = 20
+};
+
+/** Former float conversion of the sketch, truncated */
+static int32_t deg2step(float deg) {
+    return (RATIO * SPR * deg / 360);
+}
+
+/** Former float conversion of the sketch */
+static float step2deg(int32_t step) {
+    return (360.00f * step / (SPR * RATIO));
+}
+
+/** Exact conversion, rounded to the nearest step */
+static int32_t exact_step(int32_t mdeg) {
+    int64_t x = (int64_t)mdeg * TURN_STEPS;
+    int64_t d = MDEG_TURN;
+    return (int32_t)((x + (x < 0 ? -d : d) / 2) / d);
+}
+
+/** Rotator of the simulation, with the position in steps */
+struct rotator_sim {
+    int32_t step;
+    int32_t setpoint;
+    bool integer;
+
+    /** Go to a set point in mdeg, as the AZ command or the trajectory */
+    void go(int32_t mdeg) {
+        setpoint = mdeg;
+        step = integer ? mdeg2step(mdeg) : deg2step(mdeg / 1000.0f);
+    }
+
+    /** Hold the current position, as the SA, SE and TC commands */
+    void hold() {
+        if (integer) {
+            step = mdeg2step(step2mdeg(step));
+        } else {
+            step = deg2step(step2deg(step));
+        }
+    }
+};
+
+/**************************************************************************/
+/*!
+    @brief    Run tracking sessions, each one follows a pass, is stopped a
+              few times on the way and parks at 0
+    @return   Steps away from the park position after the last session
+*/
+/**************************************************************************/
+static int32_t sessions(bool integer, int count, int32_t *worst) {
+    rotator_sim r = { 0, 0, integer };
+    srand(1);
+    *worst = 0;
+    for (int n = 0; n < count; n++) {
+        int32_t az = rand() % MDEG_TURN;
+        int32_t rate = rand() % 2000 - 1000;
+        for (int t = 0; t < 900; t++) {
+            // 1 s samples of the pass, 10 ms set points
+            for (int k = 0; k < 100; k++) {
+                int32_t mdeg = az + rate * t + rate * k / 100;
+                mdeg %= MDEG_TURN;
+                if (mdeg < 0) {
+                    mdeg += MDEG_TURN;
+                }
+                r.go(mdeg);
+            }
+            if (t % 60 == 0) {
+                // The client stops and holds for a while
+                for (int k = 0; k < 100; k++) {
+                    r.hold();
+                }
+                int32_t drift = abs(r.step - exact_step(r.setpoint));
+                if (drift > *worst) {
+                    *worst = drift;
+                }
+            }
+        }
+        r.go(0);
+        for (int k = 0; k < 100; k++) {
+            r.hold();
+        }
+    }
+    return r.step;
+}
+
+int main() {
+    printf("Steps of a turn %ld, %ld steps per %ld mdeg\n",
+           (long)TURN_STEPS, (long)STEP_NUM, (long)STEP_DEN);
+
+    // Every mdeg of two turns, both ways
+    long bad_int = 0, bad_float = 0, max_float = 0;
+    for (int32_t mdeg = -2 * MDEG_TURN; mdeg <= 2 * MDEG_TURN; mdeg++) {
+        int32_t exact = exact_step(mdeg);
+        bad_int += mdeg2step(mdeg) != exact;
+        int32_t e = labs(deg2step(mdeg / 1000.0f) - exact);
+        bad_float += e != 0;
+        max_float = e > max_float ? e : max_float;
+    }
+    printf("\nmdeg to step, %ld values against the exact rounding\n",
+           4 * MDEG_TURN + 1);
+    printf("  integer %ld differ\n", bad_int);
+    printf("  float   %ld differ, up to %ld step\n", bad_float, max_float);
+
+    // Every step of two turns, to mdeg and back
+    long back_int = 0, back_float = 0;
+    for (int32_t step = -2 * TURN_STEPS; step <= 2 * TURN_STEPS; step++) {
+        back_int += mdeg2step(step2mdeg(step)) != step;
+        back_float += deg2step(step2deg(step)) != step;
+    }
+    printf("\nStep to mdeg and back, %ld steps\n", 4 * TURN_STEPS + 1);
+    printf("  integer %ld move\n", back_int);
+    printf("  float   %ld move\n", back_float);
+
+    // Long sessions, 15 min passes with stops, then park
+    const int count = 1000;
+    int32_t worst_int, worst_float;
+    int32_t park_int = sessions(true, count, &worst_int);
+    int32_t park_float = sessions(false, count, &worst_float);
+    printf("\n%d sessions of 15 min, with 15 stops of 100 holds each\n",
+           count);
+    printf("  integer park at step %ld, worst drift %ld steps\n",
+           (long)park_int, (long)worst_int);
+    printf("  float   park at step %ld, worst drift %ld steps\n",
+           (long)park_float, (long)worst_float);
+
+    // Conversions of one loop, the feedback of both axis and their set
+    // points
+    long before = 2 * (int_to_float + float_mul + float_div) +
+                  2 * (float_mul + float_div + float_to_int);
+    long after = 2 * (long_mul + long_shift) +
+                 2 * (long_shift + long_div);
+    printf("\nConversions of one loop, estimate on the ATmega328P\n");
+    printf("  float   %ld cycles\n", before);
+    printf("  integer %ld cycles, %ld saved\n", after, before - after);
+    printf("  (avr-libc costs are approximate, measure on the target)\n");
+    return bad_int != 0 || back_int != 0 || park_int != 0 || worst_int != 0;
+}
@@ -0,0 +1,353 @@
+/*!
+* @file pass_gen.cpp
+*
+* It is the host generator of the pass storage. It predicts the passes of
+* one or more satellites over a station, compresses each pass into
+* Chebyshev segments and writes the EEPROM image as Intel HEX records, to
+* send line by line to the controller.
+*
+* Usage: pass_gen tle_file lat lon alt yyddd seconds hours [min_el] [order]
+*        [tolerance]
+*
+* Licensed under the GPLv3
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "sgp4.h"
+#include "tle.h"
+
+/* Layout of the storage, as in passes.h */
+#define PASS_SIZE      896 ///< EEPROM bytes of the pass storage
+#define PASS_ORDER_MAX 8   ///< Maximum coefficients per axis of a segment
+#define PASS_HEADER    10  ///< Bytes of a pass header
+#define PASS_RECORD    16  ///< Data bytes of a HEX record
+
+#define SCAN_STEP   10.0  ///< Step of the pass search in s
+#define CHECK_STEP  0.25  ///< Step of the error check in s
+#define SEGMENT_MAX 255   ///< Longest segment in s
+
+/** Satellite and its propagator */
+struct satellite {
+    char name[32];
+    struct _elements e;
+    sgp4<double> model;
+};
+
+/** A predicted pass */
+struct pass {
+    int sat;
+    double aos, los; ///< Times in s since 2000-01-01, whole seconds
+    double max_el;
+};
+
+static observer<double> station;
+
+/**************************************************************************/
+/*!
+    @brief    Look angles of a satellite
+    @param    s
+              The satellite
+    @param    t
+              Time in s since 2000-01-01
+*/
+/**************************************************************************/
+static void look(satellite &s, double t, double *az, double *el) {
+    double r[3];
+    int32_t day = (int32_t)floor(t / 86400);
+    double ms = (t - day * 86400.0) * 1000;
+    double tsince = ((day - s.e.epoch_day) * 86400000.0 + ms -
+                     s.e.epoch_ms) / 60000.0;
+    if (s.model.propagate(tsince, r) != sgp4_no_error) {
+        *az = 0;
+        *el = -90;
+        return;
+    }
+    station.look(r, observer<double>::sidereal(day, (uint32_t)ms), az, el);
+}
+
+/** Unwrapped azimuth relative to the base, and elevation, of a pass */
+struct track_fn {
+    satellite *s;
+    double aos;
+    double base;
+    double last;
+
+    void eval(double t, double *az, double *el) {
+        look(*s, aos + t, az, el);
+        double rel = *az - base;
+        while (rel - last > 180) {
+            rel -= 360;
+        }
+        while (rel - last < -180) {
+            rel += 360;
+        }
+        last = rel;
+        *az = rel;
+    }
+};
+
+/**************************************************************************/
+/*!
+    @brief    Fit and quantize a segment, then check it. The anchor is the
+              unwrapped azimuth at the start of the segment
+    @return   Maximum pointing error in deg, the azimuth error is scaled by
+              the cosine of the elevation
+*/
+/**************************************************************************/
+static double fit(track_fn &f, double anchor, double start, double dur,
+                  int order, int16_t *c) {
+    double fa[PASS_ORDER_MAX], fe[PASS_ORDER_MAX];
+    // Sample at the Chebyshev nodes, in time order for the unwrapping
+    f.last = anchor;
+    f.eval(start, &fa[0], &fe[0]);
+    for (int k = order - 1; k >= 0; k--) {
+        double x = cos(M_PI * (k + 0.5) / order);
+        f.eval(start + (x + 1) / 2 * dur, &fa[k], &fe[k]);
+    }
+    for (int j = 0; j < order; j++) {
+        double sa = 0, se = 0;
+        for (int k = 0; k < order; k++) {
+            double w = cos(M_PI * j * (k + 0.5) / order);
+            sa += fa[k] * w;
+            se += fe[k] * w;
+        }
+        double scale = (j == 0 ? 1.0 : 2.0) / order;
+        double qa = round(sa * scale * 100);
+        double qe = round(se * scale * 100);
+        if (fabs(qa) > 32767 || fabs(qe) > 32767) {
+            return 1e9;
+        }
+        c[j] = (int16_t)qa;
+        c[order + j] = (int16_t)qe;
+    }
+    // Check the quantized series against the propagator
+    double worst = 0;
+    f.last = anchor;
+    for (double t = 0; t <= dur + 1e-9; t += CHECK_STEP) {
+        double az, el, x = 2 * t / dur - 1;
+        f.eval(start + t, &az, &el);
+        double sa = 0, se = 0;
+        for (int j = 0; j < order; j++) {
+            double tj = cos(j * acos(fmax(-1, fmin(1, x))));
+            sa += c[j] * tj;
+            se += c[order + j] * tj;
+        }
+        double ea = fabs(sa * 0.01 - az) * cos(el * M_PI / 180);
+        double ee = fabs(se * 0.01 - el);
+        worst = fmax(worst, fmax(ea, ee));
+    }
+    return worst;
+}
+
+static void put16(std::vector<uint8_t> &b, int v) {
+    b.push_back(v & 0xFF);
+    b.push_back((v >> 8) & 0xFF);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Compress a pass
+    @return   The bytes of the pass, with its header
+*/
+/**************************************************************************/
+static std::vector<uint8_t> compress(satellite &s, const pass &p, int order,
+                                     double tolerance, int *segments,
+                                     double *error) {
+    std::vector<uint8_t> out;
+    double az, el;
+    look(s, p.aos, &az, &el);
+    int base = (int)lround(az * 100) % 36000;
+    track_fn f = { &s, p.aos, base / 100.0, 0 };
+
+    int day = (int)floor(p.aos / 86400);
+    uint32_t ms = (uint32_t)lround((p.aos - day * 86400.0) * 1000);
+    out.push_back(0);
+    out.push_back(order);
+    put16(out, day);
+    put16(out, ms & 0xFFFF);
+    put16(out, ms >> 16);
+    put16(out, base);
+
+    double total = p.los - p.aos;
+    double start = 0;
+    double anchor = 0;
+    *segments = 0;
+    *error = 0;
+    while (start < total) {
+        // Longest segment within the tolerance, by bisection
+        int lo = 1, hi = (int)fmin(SEGMENT_MAX, total - start);
+        int16_t c[2 * PASS_ORDER_MAX], best[2 * PASS_ORDER_MAX];
+        double best_error = fit(f, anchor, start, lo, order, best);
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            double e = fit(f, anchor, start, mid, order, c);
+            if (e <= tolerance) {
+                lo = mid;
+                best_error = e;
+                memcpy(best, c, sizeof(c));
+            } else {
+                hi = mid - 1;
+            }
+        }
+        out.push_back(lo);
+        for (int j = 0; j < 2 * order; j++) {
+            put16(out, best[j]);
+        }
+        *error = fmax(*error, best_error);
+        (*segments)++;
+        // Unwrap the azimuth to the start of the next segment
+        f.last = anchor;
+        for (double t = start; t <= start + lo; t += CHECK_STEP) {
+            f.eval(t, &az, &el);
+        }
+        anchor = f.last;
+        start += lo;
+    }
+    out[0] = *segments;
+    return out;
+}
+
+static void hex_record(uint16_t addr, uint8_t type, const uint8_t *data,
+                       int len) {
+    uint8_t sum = len + (addr >> 8) + (addr & 0xFF) + type;
+    printf(":%02X%04X%02X", len, addr, type);
+    for (int i = 0; i < len; i++) {
+        printf("%02X", data[i]);
+        sum += data[i];
+    }
+    printf("%02X\n", (uint8_t)(-sum));
+}
+
+int main(int argc, char **argv) {
+    if (argc < 8) {
+        fprintf(stderr, "usage: %s tle_file lat lon alt yyddd seconds hours "
+                "[min_el] [order] [tolerance]\n", argv[0]);
+        return 1;
+    }
+    station.set(atof(argv[2]), atof(argv[3]), atof(argv[4]));
+    int yyddd = atoi(argv[5]);
+    double from = (365.0 * (yyddd / 1000) + (yyddd / 1000 + 3) / 4 +
+                   yyddd % 1000 - 1) * 86400 + atof(argv[6]);
+    double to = from + atof(argv[7]) * 3600;
+    double min_el = argc > 8 ? atof(argv[8]) : 10;
+    int order = argc > 9 ? atoi(argv[9]) : 5;
+    double tolerance = argc > 10 ? atof(argv[10]) : 0.02;
+    if (order < 1 || order > PASS_ORDER_MAX) {
+        fprintf(stderr, "order 1-%d\n", PASS_ORDER_MAX);
+        return 1;
+    }
+
+    // Read the TLEs, the name lines are optional
+    std::vector<satellite> sats;
+    FILE *file = fopen(argv[1], "r");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    char line[3][128] = { "", "", "" };
+    while (fgets(line[2], sizeof(line[2]), file) != NULL) {
+        line[2][strcspn(line[2], "\r\n")] = '\0';
+        satellite s;
+        if (tle_parse(line[1], line[2], &s.e)) {
+            bool named = line[0][0] != '\0' && line[0][0] != '1' &&
+                         line[0][0] != '2';
+            snprintf(s.name, sizeof(s.name), "%.31s",
+                     named ? line[0] : "unnamed");
+            if (s.model.init(s.e.bstar, s.e.ecco, s.e.argpo, s.e.inclo,
+                             s.e.mo, s.e.no_kozai, s.e.nodeo) ==
+                sgp4_no_error) {
+                sats.push_back(s);
+            } else {
+                fprintf(stderr, "%s: not a near earth orbit\n", s.name);
+            }
+        }
+        memcpy(line[0], line[1], sizeof(line[0]));
+        memcpy(line[1], line[2], sizeof(line[1]));
+    }
+    fclose(file);
+
+    // Find the passes above the horizon, with a high enough maximum
+    std::vector<pass> found;
+    for (size_t i = 0; i < sats.size(); i++) {
+        double az, el, prev = -90;
+        pass p = { (int)i, 0, 0, -90 };
+        for (double t = from; t <= to; t += SCAN_STEP) {
+            look(sats[i], t, &az, &el);
+            if (el > 0 && prev <= 0) {
+                double aos = t, e = el;
+                while (e > 0) {
+                    aos -= 1;
+                    look(sats[i], aos, &az, &e);
+                }
+                p.aos = aos + 1;
+                p.max_el = 0;
+            }
+            if (el > 0) {
+                p.max_el = fmax(p.max_el, el);
+            }
+            if (el <= 0 && prev > 0 && p.aos > 0) {
+                double los = t, e;
+                do {
+                    los -= 1;
+                    look(sats[i], los, &az, &e);
+                } while (e <= 0);
+                p.los = los;
+                if (p.max_el >= min_el && p.aos >= from) {
+                    found.push_back(p);
+                }
+                p.aos = 0;
+            }
+            prev = el;
+        }
+    }
+    std::sort(found.begin(), found.end(),
+              [](const pass &a, const pass &b) { return a.aos < b.aos; });
+
+    // Compress the passes that fit, without overlap
+    std::vector<uint8_t> image;
+    double busy = 0;
+    int stored = 0;
+    for (const pass &p : found) {
+        int day = (int)floor(p.aos / 86400);
+        double sod = p.aos - day * 86400.0;
+        if (p.aos < busy) {
+            fprintf(stderr, "skip %s at day %d %05.0f s, overlaps\n",
+                    sats[p.sat].name, day, sod);
+            continue;
+        }
+        int segments;
+        double error;
+        std::vector<uint8_t> b = compress(sats[p.sat], p, order, tolerance,
+                                          &segments, &error);
+        if (image.size() + b.size() > PASS_SIZE || segments > 254) {
+            fprintf(stderr, "skip %s at day %d %05.0f s, storage full\n",
+                    sats[p.sat].name, day, sod);
+            break;
+        }
+        image.insert(image.end(), b.begin(), b.end());
+        busy = p.los;
+        stored++;
+        fprintf(stderr, "%-16s day %d %05.0f s, %4.0f s, max el %4.1f, "
+                "%2d segments, %3zu bytes, error %.4f deg\n",
+                sats[p.sat].name, day, sod, p.los - p.aos, p.max_el,
+                segments, b.size(), error);
+    }
+    if (image.size() < PASS_SIZE) {
+        image.push_back(0xFF);
+    }
+    fprintf(stderr, "%d passes, %zu of %d bytes\n", stored, image.size(),
+            PASS_SIZE);
+
+    for (size_t addr = 0; addr < image.size(); addr += PASS_RECORD) {
+        int len = (int)fmin(PASS_RECORD, image.size() - addr);
+        hex_record(addr, 0, &image[addr], len);
+    }
+    hex_record(0, 1, NULL, 0);
+    return 0;
+}
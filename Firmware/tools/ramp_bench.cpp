@@ -0,0 +1,173 @@
+/*!
+* @file ramp_bench.cpp
+*
+* It is the host benchmark of the step interrupt. It checks the square root
+* of the table against the exact one, and estimates the cost of the square
+* root, of the steps and of the velocity profiles on the ATmega328P, with
+* the load, the longest section with the interrupts off and the time of a
+* profile, that the next ticks interrupt, at the full slew of 2, 8 and 16
+* microsteps.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sqrt_table.h"
+
+/** Approximate cycles of each operation on the AVR */
+enum _cost {
+    long_cmp = 4, long_add = 4, long_shift = 8, word_shift = 4, branch = 2,
+    lpm_word = 7, mul_8 = 2, call = 12, long_div = 650, long_mul = 60,
+    isr_entry = 40, tick_idle = 30, tick_step = 45, tick_latch = 12,
+    ramp_entry = 90, ramp_trapezoid = 180, ramp_s_curve = 260
+};
+
+#define SLEW_STEPS 800 ///< Full slew of the motor in full steps/s, 1600 at 2 microsteps
+#define RAMP_FREQ  1000 ///< Velocity profile update frequency of stepper.h in Hz
+
+/**************************************************************************/
+/*!
+    @brief    Former square root of the sketch, one bit per round
+    @param    x
+              The argument
+    @param    cycles
+              Estimated cycles on the AVR
+    @return   The root, rounded down
+*/
+/**************************************************************************/
+static uint16_t isqrt_bitwise(uint32_t x, long *cycles) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    *cycles = call;
+    while (bit > x) {
+        bit >>= 2;
+        *cycles += long_cmp + long_shift + branch;
+    }
+    while (bit != 0) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+            *cycles += long_add;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+        *cycles += 2 * long_add + long_cmp + 2 * long_shift + 2 * branch;
+    }
+    return root;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Cycles of the square root of the table, as isqrt() runs it
+    @param    x
+              The argument
+    @return   Estimated cycles on the AVR
+*/
+/**************************************************************************/
+static long isqrt_table_cycles(uint32_t x) {
+    long cycles = call;
+    if (x == 0) {
+        return cycles;
+    }
+    int shift = 0;
+    while (x >= 0x10000UL) {
+        x >>= 2;
+        shift++;
+        cycles += long_cmp + long_shift + branch;
+    }
+    while (x < 0x4000) {
+        x <<= 2;
+        shift--;
+        cycles += 2 * word_shift + branch;
+    }
+    cycles += 2 * lpm_word + mul_8 + 3 * long_add;
+    cycles += abs(7 - shift) * long_shift / 2;
+    return cycles;
+}
+
+int main() {
+    // Every argument of 24 bits, the root is within 1, and a sweep of the
+    // rest, the root is within 0.02%
+    long bad = 0;
+    double worst = 0, worst_rel = 0;
+    for (uint64_t x = 0; x <= UINT32_MAX; x += x < (1UL << 24) ? 1 : 997) {
+        double exact = sqrt((double)x);
+        double e = fabs(isqrt(x) - exact);
+        if (x < (1UL << 24)) {
+            bad += e >= 1;
+            worst = e > worst ? e : worst;
+        } else {
+            bad += e / exact > 0.0002;
+            worst_rel = e / exact > worst_rel ? e / exact : worst_rel;
+        }
+    }
+    printf("Square root of the table, %u entries of %u bytes of flash\n",
+           (unsigned)(sizeof(sqrt_lookup::entry) / sizeof(uint16_t)),
+           (unsigned)sizeof(sqrt_lookup::entry));
+    printf("  worst error %.3f below 2^24, %.4f%% above, %ld out of bounds\n",
+           worst, 100 * worst_rel, bad);
+
+    // The arguments of limit_accel() and can_cruise() span the whole range
+    long bit_sum = 0, bit_max = 0, table_sum = 0, table_max = 0;
+    const int samples = 32 * 64;
+    for (int i = 0; i < samples; i++) {
+        uint32_t x = (uint32_t)ldexp(1 + (i % 64) / 64.0, 1 + i / 64);
+        long c;
+        isqrt_bitwise(x, &c);
+        bit_sum += c;
+        bit_max = c > bit_max ? c : bit_max;
+        c = isqrt_table_cycles(x);
+        table_sum += c;
+        table_max = c > table_max ? c : table_max;
+    }
+    printf("\nSquare root, estimate on the ATmega328P, 2 to 2^32\n");
+    printf("  bitwise mean %ld, worst %ld cycles\n", bit_sum / samples,
+           bit_max);
+    printf("  table   mean %ld, worst %ld cycles\n", table_sum / samples,
+           table_max);
+
+    // The S-curve takes two roots and a division each ramp, when it brakes
+    long s_bit = ramp_s_curve + long_div + long_mul + 2 * bit_max;
+    long s_table = ramp_s_curve + long_div + long_mul + 2 * table_max;
+    printf("\nRamp of one axis, worst case\n");
+    printf("  trapezoid %ld cycles\n", (long)ramp_trapezoid);
+    printf("  S-curve   %ld cycles bitwise, %ld table\n", s_bit, s_table);
+
+    // The interrupt at the full slew of both axis
+    static const uint8_t microsteps[] = { 2, 8, 16 };
+    static const long step_freqs[] = { 20000, 20000, 40000 };
+    // The profile runs with the interrupts on, only the ticks and the entry
+    // of the ramp keep them off. The ticks that nest stretch the profile, it
+    // ends before the ramp of the other axis, half a ramp later
+    printf("\nStep interrupt at the full slew of both axis, S-curve\n");
+    printf("  micro  steps/s  STEP_FREQ  load  longest  tick  "
+           "profile  half ramp\n");
+    for (uint8_t i = 0; i < sizeof(microsteps); i++) {
+        long steps = (long)SLEW_STEPS * microsteps[i];
+        long freq = step_freqs[i];
+        long period = F_CPU / freq;
+        long tick = isr_entry + 2 * (tick_idle + tick_latch);
+        long ticks = tick * freq + 2 * tick_step * steps;
+        long load = ticks + 2 * (ramp_entry + s_table) * RAMP_FREQ;
+        long longest = tick + 2 * tick_step + ramp_entry;
+        long profile = s_table * (long)F_CPU / ((long)F_CPU - ticks);
+        long half = F_CPU / RAMP_FREQ / 2;
+        bad += longest > period || profile > half;
+        printf("  %5u  %7ld  %9ld  %3ld%%  %7ld  %4ld  %7ld  %9ld\n",
+               microsteps[i], steps, freq, 100 * load / (long)F_CPU, longest,
+               period, profile, half);
+    }
+    printf("  (cycles, the longest section with the interrupts off fits the "
+           "tick)\n");
+    printf("  (the S-curve with the interrupts off took %ld, bitwise %ld)\n",
+           isr_entry + 2 * (tick_idle + tick_latch) + 2 * tick_step + s_table,
+           isr_entry + 2 * (tick_idle + tick_latch) + 2 * tick_step + s_bit);
+    printf("  (avr-libc costs are approximate, measure on the target)\n");
+    return bad != 0;
+}
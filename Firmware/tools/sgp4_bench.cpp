@@ -0,0 +1,171 @@
+/*!
+* @file sgp4_bench.cpp
+*
+* It is the host benchmark of the on-board SGP4 propagator. It checks the
+* double build against the Spacetrack Report #3 test case, the float build
+* of the firmware against the double build, and estimates the cost of one
+* update on the ATmega328P from the operation counts.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "sgp4_model.h"
+#include "counter.h"
+#include "tle.h"
+
+unsigned long op_counts[op_count];
+
+/** Approximate avr-libc cycles of each operation on the AVR */
+static const struct {
+    const char *name;
+    unsigned cycles;
+} op_cost[op_count] = {
+    { "add/sub", 110 }, { "mul", 150 }, { "div", 480 }, { "compare", 50 },
+    { "sqrt", 490 }, { "sin/cos", 1650 }, { "atan2", 2800 },
+    { "pow", 4900 }, { "fmod", 500 }
+};
+
+/** Spacetrack Report #3, SGP4 test case, position in km */
+static const char *str3_line1 =
+    "1 88888U          80275.98708465  .00073094  13844-3  66816-4 0    8";
+static const char *str3_line2 =
+    "2 88888  72.8435 115.9689 0086731  52.6988 110.5714 16.05824518  105";
+static const double str3[5][4] = {
+    { 0,    2328.97048951, -5995.22076416, 1719.97067261 },
+    { 360,  2456.10705566, -6071.93853760, 1222.89727783 },
+    { 720,  2567.56195068, -6112.50384522, 713.96397400 },
+    { 1080, 2663.09078980, -6115.48229980, 196.39640427 },
+    { 1440, 2742.55133057, -6079.67144775, -326.38095856 }
+};
+
+/** A recent ISS TLE, for a typical LEO pass */
+static const char *iss_line1 =
+    "1 25544U 98067A   24291.51782528  .00016717  00000-0  30150-3 0  9990";
+static const char *iss_line2 =
+    "2 25544  51.6393 108.9384 0008520 131.7394 228.4257 15.49862398477413";
+
+static void parse(const char *line1, const char *line2, struct _elements *e) {
+    tle_parse(line1, line2, e);
+    // Lausanne
+    e->lat = 46.52;
+    e->lon = 6.57;
+    e->alt = 400;
+}
+
+static void utc(const struct _elements *e, double tsince, int32_t *day,
+                uint32_t *ms) {
+    double t = e->epoch_ms + tsince * 60000.0;
+    int32_t days = (int32_t)floor(t / 86400000.0);
+    *day = e->epoch_day + days;
+    *ms = (uint32_t)(t - days * 86400000.0);
+}
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main() {
+    struct _elements e;
+    double r[3], az, el;
+    int32_t day;
+    uint32_t ms;
+
+    // Reference test case
+    printf("Spacetrack Report #3, 88888, position error in km\n");
+    printf("  t [min]     double      float\n");
+    parse(str3_line1, str3_line2, &e);
+    model_init_double(&e);
+    model_init_float(&e);
+    for (int i = 0; i < 5; i++) {
+        double err[2];
+        for (int m = 0; m < 2; m++) {
+            utc(&e, str3[i][0], &day, &ms);
+            if (m == 0) {
+                model_look_double(str3[i][0], day, ms, r, &az, &el);
+            } else {
+                model_look_float(str3[i][0], day, ms, r, &az, &el);
+            }
+            err[m] = sqrt(pow(r[0] - str3[i][1], 2) +
+                          pow(r[1] - str3[i][2], 2) +
+                          pow(r[2] - str3[i][3], 2));
+        }
+        printf("  %7.0f %10.6f %10.6f\n", str3[i][0], err[0], err[1]);
+    }
+
+    // Float firmware against the double reference, one day of ISS
+    parse(iss_line1, iss_line2, &e);
+    model_init_double(&e);
+    model_init_float(&e);
+    model_init_counter(&e);
+    double max_r = 0, max_az = 0, max_el = 0;
+    int visible = 0;
+    for (double t = 0; t <= 1440; t += 10 / 60.0) {
+        double rd[3], azd, eld;
+        utc(&e, t, &day, &ms);
+        model_look_double(t, day, ms, rd, &azd, &eld);
+        model_look_float(t, day, ms, r, &az, &el);
+        double dr = sqrt(pow(r[0] - rd[0], 2) + pow(r[1] - rd[1], 2) +
+                         pow(r[2] - rd[2], 2));
+        max_r = fmax(max_r, dr);
+        if (eld > 0) {
+            double daz = fabs(az - azd);
+            daz = fmin(daz, 360 - daz) * cos(eld * M_PI / 180);
+            max_az = fmax(max_az, daz);
+            max_el = fmax(max_el, fabs(el - eld));
+            visible++;
+        }
+    }
+    printf("\nISS, 1 day every 10 s, float against double\n");
+    printf("  position error  %.3f km max\n", max_r);
+    printf("  pointing error  %.4f deg az (x cos el), %.4f deg el max, "
+           "%d visible samples\n", max_az, max_el, visible);
+
+    // Host time per update
+    const int runs = 200000;
+    double t0 = seconds();
+    for (int i = 0; i < runs; i++) {
+        double t = i * 0.01;
+        utc(&e, t, &day, &ms);
+        model_look_double(t, day, ms, r, &az, &el);
+    }
+    double t1 = seconds();
+    for (int i = 0; i < runs; i++) {
+        double t = i * 0.01;
+        utc(&e, t, &day, &ms);
+        model_look_float(t, day, ms, r, &az, &el);
+    }
+    double t2 = seconds();
+    printf("\nHost time per update, propagation and look angles\n");
+    printf("  double %.0f ns, float %.0f ns\n", (t1 - t0) / runs * 1e9,
+           (t2 - t1) / runs * 1e9);
+
+    // Operation counts of one update, float as on the AVR
+    const int updates = 1000;
+    memset(op_counts, 0, sizeof(op_counts));
+    for (int i = 0; i < updates; i++) {
+        double t = i * 1.44;
+        utc(&e, t, &day, &ms);
+        model_look_counter(t, day, ms, r, &az, &el);
+    }
+    unsigned long cycles = 0;
+    printf("\nOperations per update, average of %d, float\n", updates);
+    for (int i = 0; i < op_count; i++) {
+        double n = (double)op_counts[i] / updates;
+        cycles += op_counts[i] * op_cost[i].cycles;
+        printf("  %-8s %6.1f x %4u cycles\n", op_cost[i].name, n,
+               op_cost[i].cycles);
+    }
+    cycles /= updates;
+    printf("  estimate %lu cycles, %.1f ms at 16 MHz on the ATmega328P\n",
+           cycles, cycles / 16000.0);
+    printf("  (avr-libc costs are approximate, measure on the target)\n");
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*!
+* @file sgp4_model.cpp
+*
+* It is the propagator of the firmware, built once per number type by the
+* Makefile. The float builds use single precision constants, as avr-gcc does.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#include "sgp4_model.h"
+#include "sgp4.h"
+
+#define JOIN(a, b) a##b
+#define NAME(a, b) JOIN(a, b)
+
+static sgp4<MODEL_REAL> model;
+static observer<MODEL_REAL> station;
+
+int NAME(model_init_, MODEL_NAME)(const struct _elements *e) {
+    station.set(e->lat, e->lon, e->alt);
+    return model.init(e->bstar, e->ecco, e->argpo, e->inclo, e->mo,
+                      e->no_kozai, e->nodeo);
+}
+
+int NAME(model_look_, MODEL_NAME)(double tsince, int32_t day, uint32_t ms,
+                                   double r[3], double *az, double *el) {
+    MODEL_REAL rr[3], a, b;
+    int error = model.propagate(tsince, rr);
+    if (error != sgp4_no_error) {
+        return error;
+    }
+    station.look(rr, observer<MODEL_REAL>::sidereal(day, ms), &a, &b);
+    for (int i = 0; i < 3; i++) {
+        r[i] = (double)rr[i];
+    }
+    *az = (double)a;
+    *el = (double)b;
+    return 0;
+}
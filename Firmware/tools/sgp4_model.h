@@ -0,0 +1,32 @@
+/*!
+* @file sgp4_model.h
+*
+* It is the interface of the propagator builds for the SGP4 benchmark.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef SGP4_MODEL_H_
+#define SGP4_MODEL_H_
+
+#include <stdint.h>
+
+/** Mean elements of a TLE and the station */
+struct _elements {
+    double bstar, ecco, argpo, inclo, mo, no_kozai, nodeo; ///< SGP4 units
+    int32_t epoch_day; ///< Days since 2000-01-01
+    uint32_t epoch_ms; ///< Time of the epoch day in ms
+    double lat, lon, alt; ///< Station in deg, deg, m
+};
+
+#define MODEL_DECLARE(name) \
+    int model_init_##name(const struct _elements *e); \
+    int model_look_##name(double tsince, int32_t day, uint32_t ms, \
+                          double r[3], double *az, double *el);
+
+MODEL_DECLARE(double)
+MODEL_DECLARE(float)
+MODEL_DECLARE(counter)
+
+#endif /* SGP4_MODEL_H_ */
@@ -0,0 +1,63 @@
+/*!
+* @file tle.h
+*
+* It is the TLE reader of the host tools.
+*
+* Licensed under the GPLv3
+*
+*/
+
+#ifndef TLE_H_
+#define TLE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sgp4_model.h"
+
+/**************************************************************************/
+/*!
+    @brief    Read a TLE field between two columns, 1 based as in the format
+*/
+/**************************************************************************/
+static inline double tle_field(const char *line, int first, int last) {
+    char buffer[16];
+    int n = last - first + 1;
+    if ((int)strlen(line) < last) {
+        return 0;
+    }
+    memcpy(buffer, line + first - 1, n);
+    buffer[n] = '\0';
+    return atof(buffer);
+}
+
+/**************************************************************************/
+/*!
+    @brief    Parse a TLE into SGP4 elements, the station is not changed
+    @return   False if the lines are not a TLE
+*/
+/**************************************************************************/
+static inline bool tle_parse(const char *line1, const char *line2,
+                             struct _elements *e) {
+    if (line1[0] != '1' || line2[0] != '2' || strlen(line1) < 63 ||
+        strlen(line2) < 63) {
+        return false;
+    }
+    int yy = (int)tle_field(line1, 19, 20);
+    double doy = tle_field(line1, 21, 32);
+    int year = yy < 57 ? 2000 + yy : 1900 + yy;
+    e->epoch_day = 365 * (year - 2000) + (year - 1997 + 400) / 4 - 100 +
+                   (int)doy - 1;
+    e->epoch_ms = (uint32_t)((doy - (int)doy) * 86400000.0 + 0.5);
+    double mantissa = tle_field(line1, 54, 59) * 1e-5;
+    e->bstar = mantissa * pow(10, tle_field(line1, 60, 61));
+    e->inclo = tle_field(line2, 9, 16) * M_PI / 180;
+    e->nodeo = tle_field(line2, 18, 25) * M_PI / 180;
+    e->ecco = tle_field(line2, 27, 33) * 1e-7;
+    e->argpo = tle_field(line2, 35, 42) * M_PI / 180;
+    e->mo = tle_field(line2, 44, 51) * M_PI / 180;
+    e->no_kozai = tle_field(line2, 53, 63) * 2 * M_PI / 1440;
+    return true;
+}
+
+#endif /* TLE_H_ */